@@ -0,0 +1,151 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares the packet id allocation based on std::set, that the endpoint used before,
+// with packet_id_allocator. N packet ids are kept in use. Each step releases one of them
+// at random, that is, the acknowledgements arrive out of order, and acquires a new one.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+
+#include <mqtt/packet_id_allocator.hpp>
+
+namespace {
+
+std::size_t const times = 1000 * 1000;
+
+// The allocation that the endpoint used before.
+class set_allocator {
+public:
+    std::uint16_t acquire() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        if (ids_.size() == 0xffff) throw mqtt::packet_id_exhausted_error();
+        do {
+            if (++master_ == 0) ++master_;
+        } while (!ids_.insert(master_).second);
+        return master_;
+    }
+    void release(std::uint16_t id) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        ids_.erase(id);
+    }
+private:
+    std::mutex mtx_;
+    std::uint16_t master_ = 0;
+    std::set<std::uint16_t> ids_;
+};
+
+class locked_allocator {
+public:
+    std::uint16_t acquire() {
+        std::lock_guard<std::mutex> lck(mtx_);
+        return a_.acquire();
+    }
+    void release(std::uint16_t id) {
+        std::lock_guard<std::mutex> lck(mtx_);
+        a_.release(id);
+    }
+private:
+    std::mutex mtx_;
+    mqtt::packet_id_allocator a_;
+};
+
+class lock_free_allocator {
+public:
+    std::uint16_t acquire() {
+        return a_.acquire_lock_free();
+    }
+    void release(std::uint16_t id) {
+        a_.release_lock_free(id);
+    }
+private:
+    mqtt::packet_id_allocator a_;
+};
+
+template <typename Allocator>
+double measure(std::size_t in_use, std::size_t steps) {
+    Allocator a;
+    std::vector<std::uint16_t> ids;
+    for (std::size_t i = 0; i != in_use; ++i) ids.push_back(a.acquire());
+    std::mt19937 rng(0);
+    std::vector<std::size_t> pos(steps);
+    for (auto& p : pos) p = rng() % in_use;
+    auto start = std::chrono::steady_clock::now();
+    for (auto p : pos) {
+        a.release(ids[p]);
+        ids[p] = a.acquire();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / steps;
+}
+
+// Each thread acquires and releases its own ids concurrently.
+template <typename Allocator>
+double measure_threads(std::size_t threads) {
+    Allocator a;
+    std::vector<std::thread> ths;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t != threads; ++t) {
+        ths.emplace_back(
+            [&] {
+                std::vector<std::uint16_t> ids;
+                for (std::size_t i = 0; i != 1000; ++i) ids.push_back(a.acquire());
+                for (std::size_t i = 0; i != times / threads; ++i) {
+                    auto& id = ids[i % ids.size()];
+                    a.release(id);
+                    id = a.acquire();
+                }
+            }
+        );
+    }
+    for (auto& th : ths) th.join();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / times;
+}
+
+} // anonymous namespace
+
+int main() {
+    std::cout
+        << "release and acquire (ns/op)" << std::endl
+        << std::setw(8) << "in_use"
+        << std::setw(12) << "std::set"
+        << std::setw(12) << "bitmap"
+        << std::setw(12) << "lock_free" << std::endl;
+    for (std::size_t in_use : { 1000, 32768, 60000, 65000, 65500, 65535 }) {
+        // The std::set allocation scans the occupied ids one by one. Reduce the steps near exhaustion.
+        std::size_t steps = in_use < 65000 ? times : in_use < 65535 ? times / 100 : times / 1000;
+        std::cout
+            << std::setw(8) << in_use
+            << std::fixed << std::setprecision(2)
+            << std::setw(12) << measure<set_allocator>(in_use, steps)
+            << std::setw(12) << measure<locked_allocator>(in_use, steps)
+            << std::setw(12) << measure<lock_free_allocator>(in_use, steps) << std::endl;
+    }
+
+    std::cout
+        << std::endl
+        << "concurrent release and acquire (ns/op)" << std::endl
+        << std::setw(8) << "threads"
+        << std::setw(12) << "std::set"
+        << std::setw(12) << "bitmap"
+        << std::setw(12) << "lock_free" << std::endl;
+    for (std::size_t threads : { 1, 2, 4 }) {
+        std::cout
+            << std::setw(8) << threads
+            << std::fixed << std::setprecision(2)
+            << std::setw(12) << measure_threads<set_allocator>(threads)
+            << std::setw(12) << measure_threads<locked_allocator>(threads)
+            << std::setw(12) << measure_threads<lock_free_allocator>(threads) << std::endl;
+    }
+}
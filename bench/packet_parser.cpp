@@ -0,0 +1,150 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the decode throughput of packet_parser without I/O.
+// A pre-encoded stream of PUBLISH, PUBACK, and PINGRESP packets is parsed repeatedly.
+// The contents are notified as views and not read, so MB/s grows with the payload size.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <tuple>
+
+#include <mqtt/packet_parser.hpp>
+#include <mqtt/remaining_length.hpp>
+
+namespace {
+
+// Counts the decoded packets, and touches the decoded values
+// so that the compiler doesn't remove them.
+struct counter {
+    bool on_connect(std::string,
+                    boost::optional<std::string>,
+                    boost::optional<std::string>,
+                    boost::optional<mqtt::will>,
+                    bool,
+                    std::uint16_t) { ++packets; return true; }
+    bool on_connack(bool, std::uint8_t) { ++packets; return true; }
+    bool on_publish(std::uint8_t,
+                    boost::optional<std::uint16_t> packet_id,
+                    mqtt::string_view topic_name,
+                    mqtt::string_view contents) {
+        ++packets;
+        sum += topic_name.size() + contents.size() + (packet_id ? *packet_id : 0);
+        return true;
+    }
+    bool on_publish_begin(std::uint8_t,
+                          boost::optional<std::uint16_t>,
+                          mqtt::string_view,
+                          std::size_t) { return true; }
+    bool on_publish_chunk(mqtt::string_view, bool) { return true; }
+    bool on_puback(std::uint16_t packet_id) { ++packets; sum += packet_id; return true; }
+    bool on_pubrec(std::uint16_t) { ++packets; return true; }
+    bool on_pubrel(std::uint16_t) { ++packets; return true; }
+    bool on_pubcomp(std::uint16_t) { ++packets; return true; }
+    bool on_subscribe(std::uint16_t, std::vector<std::tuple<std::string, std::uint8_t>>) { ++packets; return true; }
+    bool on_suback(std::uint16_t, std::vector<boost::optional<std::uint8_t>>) { ++packets; return true; }
+    bool on_unsubscribe(std::uint16_t, std::vector<std::string>) { ++packets; return true; }
+    bool on_unsuback(std::uint16_t) { ++packets; return true; }
+    bool on_pingreq() { ++packets; return true; }
+    bool on_pingresp() { ++packets; return true; }
+    bool on_disconnect() { ++packets; return true; }
+
+    std::size_t packets = 0;
+    std::size_t sum = 0;
+};
+
+// Prevent the compiler from removing the measured loops.
+std::size_t volatile sink;
+
+void append_publish(std::string& s, std::uint16_t packet_id, std::size_t payload_size) {
+    static std::string const topic = "sensor/building1/floor2/room3/temperature";
+    std::size_t remaining_length = 2 + topic.size() + 2 + payload_size;
+    s.push_back(static_cast<char>(0x32)); // PUBLISH QoS1
+    char rl[4];
+    s.append(rl, mqtt::encode_remaining_length(remaining_length, rl));
+    s.push_back(static_cast<char>(topic.size() >> 8));
+    s.push_back(static_cast<char>(topic.size() & 0xff));
+    s += topic;
+    s.push_back(static_cast<char>(packet_id >> 8));
+    s.push_back(static_cast<char>(packet_id & 0xff));
+    s.append(payload_size, 'x');
+}
+
+void append_puback(std::string& s, std::uint16_t packet_id) {
+    s.push_back(static_cast<char>(0x40));
+    s.push_back(static_cast<char>(0x02));
+    s.push_back(static_cast<char>(packet_id >> 8));
+    s.push_back(static_cast<char>(packet_id & 0xff));
+}
+
+void append_pingresp(std::string& s) {
+    s.push_back(static_cast<char>(0xd0));
+    s.push_back(static_cast<char>(0x00));
+}
+
+// About 4MiB of the packets that a QoS1 publisher and subscriber receives.
+// Each PUBLISH is followed by a PUBACK, and a PINGRESP is mixed every 64 PUBLISHes.
+std::string make_stream(std::size_t payload_size) {
+    std::string s;
+    for (std::uint16_t id = 1; s.size() < 4 * 1024 * 1024; ++id) {
+        append_publish(s, id, payload_size);
+        append_puback(s, id);
+        if (id % 64 == 0) append_pingresp(s);
+    }
+    return s;
+}
+
+struct throughput {
+    double mbps;
+    double pps;
+};
+
+throughput measure(std::string const& stream, bool utf8_check) {
+    mqtt::packet_parser parser;
+    parser.set_utf8_check(utf8_check);
+    counter c;
+    std::size_t const times = 256 * 1024 * 1024 / stream.size() + 1;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < times; ++i) {
+        auto r = parser.parse(stream.data(), stream.size(), c);
+        if (r.st != mqtt::packet_parser::status::need_more || r.consumed != stream.size()) {
+            std::cerr << "unexpected result" << std::endl;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink = c.sum;
+    double sec = std::chrono::duration<double>(end - start).count();
+    return throughput {
+        static_cast<double>(times * stream.size()) / sec / 1e6,
+        static_cast<double>(c.packets) / sec
+    };
+}
+
+} // anonymous namespace
+
+int main() {
+    std::cout
+        << "Packet decode throughput" << std::endl
+        << std::setw(8) << "payload"
+        << std::setw(12) << "MB/s"
+        << std::setw(14) << "packets/s"
+        << std::setw(16) << "MB/s no utf8"
+        << std::setw(18) << "packets/s no utf8" << std::endl;
+    for (std::size_t payload_size : { 0, 16, 64, 256, 1024, 16384 }) {
+        auto stream = make_stream(payload_size);
+        auto checked = measure(stream, true);
+        auto unchecked = measure(stream, false);
+        std::cout
+            << std::setw(8) << payload_size << std::fixed << std::setprecision(1)
+            << std::setw(12) << checked.mbps
+            << std::setw(14) << std::setprecision(0) << checked.pps
+            << std::setw(16) << std::setprecision(1) << unchecked.mbps
+            << std::setw(18) << std::setprecision(0) << unchecked.pps << std::endl;
+    }
+}
@@ -0,0 +1,126 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the QoS1 publish throughput with the session stores.
+// Each round publishes batch messages asynchronously to a loopback socket, and then acknowledges them
+// as if PUBACK is received, that is, each message is added to and removed from the session store.
+// The log file is created in the current directory.
+
+#if !defined(MQTT_NO_TLS)
+#define MQTT_NO_TLS
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <cstdio>
+
+#include <mqtt/endpoint.hpp>
+#include <mqtt/threading_policy.hpp>
+#include <mqtt/log_session_store.hpp>
+
+namespace as = boost::asio;
+
+namespace {
+
+std::size_t const batch = 100;
+char const* const path = "bench_session_store.log";
+
+// Connected pair of sockets on the loopback. The bytes received by the peer are discarded by a thread.
+struct connection {
+    explicit connection(as::io_service& ios)
+        :socket(new as::ip::tcp::socket(ios)),
+         peer(peer_ios) {
+        as::ip::tcp::acceptor acceptor(peer_ios, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+        socket->connect(acceptor.local_endpoint());
+        acceptor.accept(peer);
+        drain = std::thread(
+            [this] {
+                static char buf[64 * 1024];
+                boost::system::error_code ec;
+                while (!ec) peer.read_some(as::buffer(buf), ec);
+            }
+        );
+    }
+
+    ~connection() {
+        drain.join();
+    }
+
+    as::io_service peer_ios;
+    std::unique_ptr<as::ip::tcp::socket> socket;
+    as::ip::tcp::socket peer;
+    std::thread drain;
+};
+
+using endpoint_t = mqtt::endpoint<
+    as::ip::tcp::socket,
+    mqtt::single_threaded::strand,
+    mqtt::single_threaded::mutex,
+    mqtt::single_threaded::lock_guard>;
+
+struct publisher : endpoint_t {
+    publisher(as::io_service& ios, std::unique_ptr<as::ip::tcp::socket> socket)
+        :endpoint_t(ios) {
+        endpoint_t::socket() = std::move(socket);
+        set_connect();
+    }
+};
+
+// Returns the publishes per second.
+double measure(std::shared_ptr<mqtt::session_store> store, std::size_t times, std::string const& payload) {
+    as::io_service ios;
+    connection c(ios);
+    auto p = std::make_shared<publisher>(ios, std::move(c.socket));
+    if (store) p->set_session_store(store);
+    std::vector<std::uint16_t> packet_ids;
+    packet_ids.reserve(batch);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < times; i += batch) {
+        for (std::size_t j = 0; j < batch; ++j) {
+            packet_ids.push_back(p->async_publish_at_least_once("sensor/1/temperature", payload));
+        }
+        ios.run();
+        ios.reset();
+        for (auto packet_id : packet_ids) p->clear_stored_publish(packet_id);
+        packet_ids.clear();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return times / std::chrono::duration<double>(end - start).count();
+}
+
+std::shared_ptr<mqtt::session_store> log_store(mqtt::fsync_policy policy) {
+    std::remove(path);
+    return std::make_shared<mqtt::log_session_store>(path, policy);
+}
+
+} // anonymous namespace
+
+int main() {
+    std::cout
+        << "QoS1 publish and acknowledge by " << batch << " (publishes/s)" << std::endl
+        << std::setw(10) << "payload"
+        << std::setw(12) << "memory"
+        << std::setw(12) << "never"
+        << std::setw(12) << "batched"
+        << std::setw(12) << "always" << std::endl;
+    for (std::size_t payload_size : { 16, 256, 4096 }) {
+        std::string const payload(payload_size, 'x');
+        std::cout
+            << std::setw(10) << payload_size
+            << std::fixed << std::setprecision(0)
+            << std::setw(12) << measure(nullptr, 1000 * 1000, payload)
+            << std::setw(12) << measure(log_store(mqtt::fsync_policy::never), 200 * 1000, payload)
+            << std::setw(12) << measure(log_store(mqtt::fsync_policy::batched), 200 * 1000, payload)
+            << std::setw(12) << measure(log_store(mqtt::fsync_policy::always), 1000, payload)
+            << std::endl;
+    }
+    std::remove(path);
+}
@@ -0,0 +1,146 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares the in-flight message store based on boost::multi_index, that the endpoint used before,
+// with flat_store. N messages are kept in flight. Each step acknowledges one message, that is,
+// finds and erases it by packet id, and stores a new message with the released packet id.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/composite_key.hpp>
+
+#include <mqtt/flat_store.hpp>
+
+namespace mi = boost::multi_index;
+
+namespace {
+
+std::size_t const times = 2 * 1000 * 1000;
+
+struct store {
+    store(std::uint16_t id, std::uint8_t type, std::shared_ptr<std::string> const& b)
+        :packet_id_(id), expected_control_packet_type_(type), buf_(b) {}
+    std::uint16_t packet_id() const { return packet_id_; }
+    std::uint8_t expected_control_packet_type() const { return expected_control_packet_type_; }
+private:
+    std::uint16_t packet_id_;
+    std::uint8_t expected_control_packet_type_;
+    std::shared_ptr<std::string> buf_;
+};
+
+struct tag_packet_id {};
+struct tag_packet_id_type {};
+struct tag_seq {};
+using mi_store = mi::multi_index_container<
+    store,
+    mi::indexed_by<
+        mi::ordered_unique<
+            mi::tag<tag_packet_id_type>,
+            mi::composite_key<
+                store,
+                mi::const_mem_fun<store, std::uint16_t, &store::packet_id>,
+                mi::const_mem_fun<store, std::uint8_t, &store::expected_control_packet_type>
+            >
+        >,
+        mi::ordered_non_unique<
+            mi::tag<tag_packet_id>,
+            mi::const_mem_fun<store, std::uint16_t, &store::packet_id>
+        >,
+        mi::sequenced<
+            mi::tag<tag_seq>
+        >
+    >
+>;
+
+std::uint8_t const puback = 4;
+
+// Returns the order of the packet ids to acknowledge.
+// If in_order is false, one of the oldest 64 messages is acknowledged.
+std::vector<std::uint16_t> acks(std::size_t in_flight, bool in_order) {
+    std::deque<std::uint16_t> flight;
+    for (std::size_t i = 1; i <= in_flight; ++i) flight.push_back(static_cast<std::uint16_t>(i));
+    std::mt19937 rng(0);
+    std::vector<std::uint16_t> ret;
+    ret.reserve(times);
+    for (std::size_t i = 0; i < times; ++i) {
+        std::size_t pos = in_order ? 0 : rng() % std::min<std::size_t>(64, flight.size());
+        auto id = flight[pos];
+        flight.erase(flight.begin() + static_cast<std::ptrdiff_t>(pos));
+        flight.push_back(id);
+        ret.push_back(id);
+    }
+    return ret;
+}
+
+template <typename F>
+double measure(std::vector<std::uint16_t> const& ids, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (auto id : ids) f(id);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / ids.size();
+}
+
+} // anonymous namespace
+
+int main() {
+    auto buf = std::make_shared<std::string>(16, 'x');
+
+    std::cout
+        << "ack and store (ns/op)" << std::endl
+        << std::setw(10) << "in_flight"
+        << std::setw(10) << "order"
+        << std::setw(13) << "multi_index"
+        << std::setw(13) << "flat_store" << std::endl;
+    for (std::size_t in_flight : { 10000, 30000, 60000 }) {
+        for (bool in_order : { true, false }) {
+            auto ids = acks(in_flight, in_order);
+
+            mi_store ms;
+            for (std::size_t i = 1; i <= in_flight; ++i) {
+                ms.emplace(static_cast<std::uint16_t>(i), puback, buf);
+            }
+            auto mi_ns = measure(ids, [&](std::uint16_t id) {
+                auto& idx = ms.get<tag_packet_id_type>();
+                idx.erase(idx.find(std::make_tuple(id, puback)));
+                ms.emplace(id, puback, buf);
+            });
+
+            mqtt::flat_store<store> fs;
+            for (std::size_t i = 1; i <= in_flight; ++i) {
+                auto id = static_cast<std::uint16_t>(i);
+                fs.emplace(id, id, puback, buf);
+            }
+            auto fs_ns = measure(ids, [&](std::uint16_t id) {
+                auto e = fs.find(id);
+                if (e && e->expected_control_packet_type() == puback) fs.erase(id);
+                fs.emplace(id, id, puback, buf);
+            });
+
+            if (ms.size() != fs.size()) {
+                std::cout << "size mismatch" << std::endl;
+                return 1;
+            }
+            std::cout
+                << std::setw(10) << in_flight
+                << std::setw(10) << (in_order ? "fifo" : "random")
+                << std::fixed << std::setprecision(2)
+                << std::setw(13) << mi_ns
+                << std::setw(13) << fs_ns << std::endl;
+        }
+    }
+}
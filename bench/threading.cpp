@@ -0,0 +1,137 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares the per message cost of the threading policies.
+// Each message is a QoS1 publish that is stored, written to a loopback socket,
+// and then acknowledged, that is, its stored packet and packet id are released.
+
+#if !defined(MQTT_NO_TLS)
+#define MQTT_NO_TLS
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <memory>
+#include <vector>
+#include <thread>
+
+#include <mqtt/endpoint.hpp>
+#include <mqtt/threading_policy.hpp>
+
+namespace as = boost::asio;
+
+namespace {
+
+std::size_t const times = 500 * 1000;
+std::size_t const batch = 1000;
+
+// Connected pair of sockets on the loopback. The bytes received by the peer are discarded by a thread.
+struct connection {
+    explicit connection(as::io_service& ios)
+        :socket(new as::ip::tcp::socket(ios)),
+         peer(peer_ios) {
+        as::ip::tcp::acceptor acceptor(peer_ios, as::ip::tcp::endpoint(as::ip::address_v4::loopback(), 0));
+        socket->connect(acceptor.local_endpoint());
+        acceptor.accept(peer);
+        drain = std::thread(
+            [this] {
+                static char buf[64 * 1024];
+                boost::system::error_code ec;
+                while (!ec) peer.read_some(as::buffer(buf), ec);
+            }
+        );
+    }
+
+    ~connection() {
+        drain.join();
+    }
+
+    as::io_service peer_ios;
+    std::unique_ptr<as::ip::tcp::socket> socket;
+    as::ip::tcp::socket peer;
+    std::thread drain;
+};
+
+template <typename ThreadingPolicy>
+struct publisher : mqtt::endpoint<
+    as::ip::tcp::socket,
+    typename ThreadingPolicy::strand,
+    typename ThreadingPolicy::mutex,
+    ThreadingPolicy::template lock_guard> {
+    using base = mqtt::endpoint<
+        as::ip::tcp::socket,
+        typename ThreadingPolicy::strand,
+        typename ThreadingPolicy::mutex,
+        ThreadingPolicy::template lock_guard>;
+
+    publisher(as::io_service& ios, std::unique_ptr<as::ip::tcp::socket> socket)
+        :base(ios) {
+        base::socket() = std::move(socket);
+        base::set_connect();
+    }
+
+    // Acknowledge the packet id as if the puback is received.
+    using base::clear_stored_publish;
+};
+
+template <typename ThreadingPolicy>
+double measure_sync() {
+    as::io_service ios;
+    connection c(ios);
+    auto p = std::make_shared<publisher<ThreadingPolicy>>(ios, std::move(c.socket));
+    std::string const payload(16, 'x');
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < times; ++i) {
+        auto packet_id = p->publish_at_least_once("topic1", payload);
+        p->clear_stored_publish(packet_id);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / times;
+}
+
+template <typename ThreadingPolicy>
+double measure_async() {
+    as::io_service ios;
+    connection c(ios);
+    auto p = std::make_shared<publisher<ThreadingPolicy>>(ios, std::move(c.socket));
+    std::string const payload(16, 'x');
+    std::vector<std::uint16_t> packet_ids;
+    packet_ids.reserve(batch);
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < times; i += batch) {
+        for (std::size_t j = 0; j < batch; ++j) {
+            packet_ids.push_back(p->async_publish_at_least_once("topic1", payload));
+        }
+        ios.run();
+        ios.reset();
+        for (auto packet_id : packet_ids) p->clear_stored_publish(packet_id);
+        packet_ids.clear();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / times;
+}
+
+} // anonymous namespace
+
+int main() {
+    std::cout
+        << "QoS1 publish and acknowledge (ns/op)" << std::endl
+        << std::setw(20) << "policy"
+        << std::setw(10) << "sync"
+        << std::setw(10) << "async" << std::endl
+        << std::fixed << std::setprecision(2)
+        << std::setw(20) << "single_threaded"
+        << std::setw(10) << measure_sync<mqtt::single_threaded>()
+        << std::setw(10) << measure_async<mqtt::single_threaded>() << std::endl
+        << std::setw(20) << "strand_serialized"
+        << std::setw(10) << measure_sync<mqtt::strand_serialized>()
+        << std::setw(10) << measure_async<mqtt::strand_serialized>() << std::endl
+        << std::setw(20) << "multi_threaded"
+        << std::setw(10) << measure_sync<mqtt::multi_threaded>()
+        << std::setw(10) << measure_async<mqtt::multi_threaded>() << std::endl;
+}
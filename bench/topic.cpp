@@ -0,0 +1,108 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares publishing by the topic name string with publishing by the topic_handle.
+// The packets are written to a socket that discards them, so only the send path is measured.
+
+#if !defined(MQTT_NO_TLS)
+#define MQTT_NO_TLS
+#endif
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <memory>
+
+#include <mqtt/endpoint.hpp>
+#include <mqtt/null_strand.hpp>
+#include <mqtt/topic_handle.hpp>
+
+namespace as = boost::asio;
+
+namespace {
+
+std::size_t const times = 5 * 1000 * 1000;
+
+// Synchronous write stream that discards the written bytes.
+class null_socket {
+public:
+    explicit null_socket(as::io_service& ios):ios_(ios) {}
+
+    as::io_service& get_io_service() { return ios_; }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(ConstBufferSequence const& buffers, boost::system::error_code& ec) {
+        ec = boost::system::error_code();
+        std::size_t size = as::buffer_size(buffers);
+        written += size;
+        return size;
+    }
+
+    template <typename ConstBufferSequence>
+    std::size_t write_some(ConstBufferSequence const& buffers) {
+        boost::system::error_code ec;
+        return write_some(buffers, ec);
+    }
+
+    void shutdown(boost::system::error_code& ec) {
+        ec = boost::system::error_code();
+    }
+
+    std::size_t written = 0;
+
+private:
+    as::io_service& ios_;
+};
+
+using endpoint_t = mqtt::endpoint<null_socket, mqtt::null_strand>;
+
+struct publisher : endpoint_t {
+    explicit publisher(as::io_service& ios)
+        :endpoint_t(std::unique_ptr<null_socket>(new null_socket(ios))) {}
+};
+
+template <typename F>
+double measure(F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < times; ++i) f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / times;
+}
+
+} // anonymous namespace
+
+int main() {
+    as::io_service ios;
+    publisher p(ios);
+
+    std::cout
+        << "QoS0 publish (ns/op)" << std::endl
+        << std::setw(8) << "topic"
+        << std::setw(10) << "payload"
+        << std::setw(10) << "string"
+        << std::setw(10) << "handle" << std::endl;
+    for (std::size_t topic_size : { 8, 40, 200 }) {
+        std::string topic;
+        while (topic.size() < topic_size) topic += "sensor/building1/floor2/room3/temperature/";
+        topic.resize(topic_size);
+        mqtt::topic_handle handle(topic);
+        for (std::size_t payload_size : { 0, 8, 64 }) {
+            std::string const payload(payload_size, 'x');
+            std::cout
+                << std::setw(8) << topic_size
+                << std::setw(10) << payload_size
+                << std::fixed << std::setprecision(2)
+                << std::setw(10) << measure([&] {
+                       p.publish_at_most_once(topic, payload);
+                   })
+                << std::setw(10) << measure([&] {
+                       p.publish_at_most_once(handle, payload);
+                   }) << std::endl;
+        }
+    }
+    std::cout << "written " << p.socket()->written << " bytes" << std::endl;
+}
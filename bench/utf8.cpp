@@ -0,0 +1,87 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the throughput of UTF-8 encoded string validation.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#include <mqtt/utf8encoded_strings.hpp>
+
+namespace {
+
+std::string make_ascii(std::size_t size) {
+    static std::string const pattern = "sensor/building1/floor2/room3/temperature/";
+    std::string s;
+    while (s.size() < size) s += pattern;
+    s.resize(size);
+    return s;
+}
+
+std::string make_mixed(std::size_t size) {
+    // ASCII levels separated by U+3042 levels.
+    static std::string const pattern = "sensor/\xe3\x81\x82\xe3\x81\x84/";
+    std::string s;
+    while (s.size() + pattern.size() <= size) s += pattern;
+    s += std::string(size - s.size(), 'a');
+    return s;
+}
+
+template <typename F>
+double measure(std::string const& str, F f) {
+    std::size_t const total = 256 * 1024 * 1024;
+    std::size_t const times = total / str.size() + 1;
+    std::size_t valid = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < times; ++i) {
+        // Prevent the compiler from hoisting the validation out of the loop.
+        char const* volatile p = str.data();
+        valid += f(p, str.size()) != mqtt::utf8string::validation::ill_formed;
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (valid != times) std::cerr << "unexpected result" << std::endl;
+    double sec = std::chrono::duration<double>(end - start).count();
+    return static_cast<double>(times * str.size()) / sec / 1e9;
+}
+
+} // anonymous namespace
+
+int main() {
+    auto simd = [](char const* p, std::size_t size) {
+        return mqtt::utf8string::validate_contents(mqtt::string_view(p, size));
+    };
+    auto scalar = [](char const* p, std::size_t size) {
+        return mqtt::utf8string::detail::validate_scalar(
+            reinterpret_cast<unsigned char const*>(p), size);
+    };
+    std::cout
+        << "UTF-8 validation throughput (GB/s)" << std::endl
+#if defined(__AVX2__)
+        << "vector instructions: AVX2" << std::endl
+#elif defined(MQTT_UTF8_SSE2)
+        << "vector instructions: SSE2" << std::endl
+#else
+        << "vector instructions: none" << std::endl
+#endif
+        << std::setw(8) << "length"
+        << std::setw(14) << "ascii"
+        << std::setw(14) << "ascii scalar"
+        << std::setw(14) << "mixed"
+        << std::setw(14) << "mixed scalar" << std::endl;
+    for (std::size_t size : { 8, 16, 32, 64, 128, 256, 1024, 65535 }) {
+        auto ascii = make_ascii(size);
+        auto mixed = make_mixed(size);
+        std::cout
+            << std::setw(8) << size << std::fixed << std::setprecision(2)
+            << std::setw(14) << measure(ascii, simd)
+            << std::setw(14) << measure(ascii, scalar)
+            << std::setw(14) << measure(mixed, simd)
+            << std::setw(14) << measure(mixed, scalar) << std::endl;
+    }
+}
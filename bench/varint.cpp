@@ -0,0 +1,107 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares the remaining length and string length encoders and decoders
+// that write into caller-provided bytes with the ones that return std::string.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+
+#include <mqtt/remaining_length.hpp>
+#include <mqtt/encoded_length.hpp>
+
+namespace {
+
+std::size_t const times = 20 * 1000 * 1000;
+
+// Prevent the compiler from removing the measured loops.
+std::size_t volatile sink;
+
+// Remaining lengths that are encoded into the bytes.
+// If bytes is 0, the lengths of 2 to 4 bytes are mixed, so the branches are hard to predict.
+std::vector<std::size_t> make_sizes(std::size_t bytes) {
+    std::size_t const lower[] = { 0, 0x80, 0x4000, 0x200000 };
+    std::size_t const upper[] = { 0x7f, 0x3fff, 0x1fffff, 0xfffffff };
+    std::mt19937 gen(static_cast<std::mt19937::result_type>(bytes));
+    std::uniform_int_distribution<std::size_t> mixed(2, 4);
+    std::vector<std::size_t> sizes(1024);
+    for (auto& s : sizes) {
+        std::size_t b = bytes == 0 ? mixed(gen) : bytes;
+        s = std::uniform_int_distribution<std::size_t>(lower[b - 1], upper[b - 1])(gen);
+    }
+    return sizes;
+}
+
+template <typename F>
+double measure(F f) {
+    auto start = std::chrono::steady_clock::now();
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < times; ++i) sum += f(i);
+    auto end = std::chrono::steady_clock::now();
+    sink = sum;
+    return std::chrono::duration<double, std::nano>(end - start).count() / times;
+}
+
+} // anonymous namespace
+
+int main() {
+    std::cout
+        << "Remaining length (ns/op)" << std::endl
+        << std::setw(6) << "bytes"
+        << std::setw(16) << "remaining_bytes"
+        << std::setw(10) << "encode"
+        << std::setw(18) << "remaining_length"
+        << std::setw(10) << "decode" << std::endl;
+    for (std::size_t bytes : { 1, 2, 3, 4, 0 }) {
+        auto sizes = make_sizes(bytes);
+        std::vector<std::string> strs;
+        std::vector<char> encoded(sizes.size() * 8);
+        for (std::size_t i = 0; i != sizes.size(); ++i) {
+            strs.push_back(mqtt::remaining_bytes(sizes[i]));
+            // 4 bytes or more are available after the remaining length in the receive buffer.
+            mqtt::encode_remaining_length(sizes[i], &encoded[i * 8]);
+        }
+        auto mask = sizes.size() - 1;
+        std::cout
+            << std::setw(6) << (bytes == 0 ? std::string("2-4") : std::to_string(bytes))
+            << std::fixed << std::setprecision(2)
+            << std::setw(16) << measure([&](std::size_t i) {
+                   return mqtt::remaining_bytes(sizes[i & mask]).size();
+               })
+            << std::setw(10) << measure([&](std::size_t i) {
+                   char out[4];
+                   return static_cast<std::size_t>(
+                       mqtt::encode_remaining_length(sizes[i & mask], out) - out + out[0]);
+               })
+            << std::setw(18) << measure([&](std::size_t i) {
+                   return std::get<0>(mqtt::remaining_length(strs[i & mask]));
+               })
+            << std::setw(10) << measure([&](std::size_t i) {
+                   std::size_t length = 0;
+                   mqtt::decode_remaining_length(&encoded[(i & mask) * 8], 8, length);
+                   return length;
+               }) << std::endl;
+    }
+
+    std::string const str("sensor/building1/floor2/room3/temperature");
+    std::cout
+        << std::endl
+        << "String length (ns/op)" << std::endl
+        << std::setw(16) << "encoded_length"
+        << std::setw(16) << "encode_length" << std::endl
+        << std::setw(16) << measure([&](std::size_t i) {
+               return static_cast<std::size_t>(mqtt::encoded_length(str)[i & 1]);
+           })
+        << std::setw(16) << measure([&](std::size_t i) {
+               char out[2];
+               mqtt::encode_length(str.size() + (i & 1), out);
+               return static_cast<std::size_t>(out[1]);
+           }) << std::endl;
+}
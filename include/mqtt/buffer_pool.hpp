@@ -0,0 +1,144 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_BUFFER_POOL_HPP)
+#define MQTT_BUFFER_POOL_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+namespace mqtt {
+
+/**
+ * @brief Pool of fixed size buffers.
+ *
+ * acquire() returns a buffer that goes back to the pool when the last reference is dropped.
+ * Buffers can be released on any thread, even after the pool is destroyed.
+ */
+class buffer_pool {
+public:
+    /**
+     * @brief Constructor
+     * @param buffer_size the size of pooled buffers
+     * @param max_pooled the maximum number of buffers kept in the pool
+     */
+    explicit buffer_pool(std::size_t buffer_size, std::size_t max_pooled = 16)
+        :impl_(std::make_shared<impl>(buffer_size, max_pooled)) {}
+
+    /**
+     * @brief Acquire a buffer.
+     * @param size minimum size of the buffer
+     * @return buffer
+     *
+     * If size is bigger than the pooled buffer size, a dedicated buffer is allocated.
+     * It is freed instead of being pooled when it is released.
+     */
+    std::shared_ptr<std::vector<char>> acquire(std::size_t size) {
+        std::unique_ptr<std::vector<char>> buf;
+        {
+            std::lock_guard<std::mutex> lck (impl_->mtx);
+            if (size <= impl_->buffer_size && !impl_->pooled.empty()) {
+                buf = std::move(impl_->pooled.back());
+                impl_->pooled.pop_back();
+                ++impl_->hit;
+            }
+            else {
+                ++impl_->miss;
+            }
+            if (!buf) buf.reset(new std::vector<char>(std::max(size, impl_->buffer_size)));
+        }
+        std::weak_ptr<impl> wp = impl_;
+        return std::shared_ptr<std::vector<char>>(
+            buf.release(),
+            [wp](std::vector<char>* p) {
+                std::unique_ptr<std::vector<char>> up(p);
+                if (auto sp = wp.lock()) sp->release(std::move(up));
+            }
+        );
+    }
+
+    /**
+     * @brief Set the size of pooled buffers.
+     * @param size buffer size
+     *
+     * Buffers that have the different size are not pooled anymore.
+     */
+    void set_buffer_size(std::size_t size) {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        if (impl_->buffer_size == size) return;
+        impl_->buffer_size = size;
+        impl_->pooled.clear();
+    }
+
+    /**
+     * @brief Set the maximum number of buffers kept in the pool.
+     * @param num number of buffers
+     */
+    void set_max_pooled(std::size_t num) {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        impl_->max_pooled = num;
+        if (impl_->pooled.size() > num) impl_->pooled.resize(num);
+    }
+
+    std::size_t buffer_size() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->buffer_size;
+    }
+
+    /**
+     * @brief Get the number of acquire() served by a pooled buffer.
+     */
+    std::size_t hit_count() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->hit;
+    }
+
+    /**
+     * @brief Get the number of acquire() that allocated a new buffer.
+     */
+    std::size_t miss_count() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->miss;
+    }
+
+    /**
+     * @brief Get the number of buffers currently kept in the pool.
+     */
+    std::size_t pooled_count() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->pooled.size();
+    }
+
+private:
+    struct impl {
+        impl(std::size_t buffer_size, std::size_t max_pooled)
+            :buffer_size(buffer_size),
+             max_pooled(max_pooled),
+             hit(0),
+             miss(0) {}
+
+        void release(std::unique_ptr<std::vector<char>> buf) {
+            std::lock_guard<std::mutex> lck (mtx);
+            if (buf->size() == buffer_size && pooled.size() < max_pooled) {
+                pooled.push_back(std::move(buf));
+            }
+        }
+
+        mutable std::mutex mtx;
+        std::size_t buffer_size;
+        std::size_t max_pooled;
+        std::size_t hit;
+        std::size_t miss;
+        std::vector<std::unique_ptr<std::vector<char>>> pooled;
+    };
+    std::shared_ptr<impl> impl_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_BUFFER_POOL_HPP
@@ -28,17 +28,25 @@
 #endif // !defined(MQTT_NO_TLS)
 
 #include <mqtt/endpoint.hpp>
-#include <mqtt/null_strand.hpp>
+#include <mqtt/threading_policy.hpp>
 
 namespace mqtt {
 
 namespace as = boost::asio;
 namespace mi = boost::multi_index;
 
-template <typename Socket, typename Strand>
-class client : public endpoint<Socket, Strand> {
-    using this_type = client<Socket, Strand>;
-    using base = endpoint<Socket, Strand>;
+template <typename Socket, typename ThreadingPolicy = multi_threaded>
+class client : public endpoint<
+    Socket,
+    typename ThreadingPolicy::strand,
+    typename ThreadingPolicy::mutex,
+    ThreadingPolicy::template lock_guard> {
+    using this_type = client<Socket, ThreadingPolicy>;
+    using base = endpoint<
+        Socket,
+        typename ThreadingPolicy::strand,
+        typename ThreadingPolicy::mutex,
+        ThreadingPolicy::template lock_guard>;
 public:
     using async_handler_t = typename base::async_handler_t;
     using close_handler = typename base::close_handler;
@@ -48,6 +56,10 @@ public:
     using pubrec_handler = typename base::pubrec_handler;
     using pubcomp_handler = typename base::pubcomp_handler;
     using publish_handler = typename base::publish_handler;
+    using publish_view_handler = typename base::publish_view_handler;
+    using publish_buffer_handler = typename base::publish_buffer_handler;
+    using publish_begin_handler = typename base::publish_begin_handler;
+    using publish_chunk_handler = typename base::publish_chunk_handler;
     using suback_handler = typename base::suback_handler;
     using unsuback_handler = typename base::unsuback_handler;
     using pingresp_handler = typename base::pingresp_handler;
@@ -62,44 +74,64 @@ public:
     }
 
     /**
-     * @breif Create no tls client with strand.
+     * @breif Create no tls client with strand and locks. See multi_threaded.
      * @param ios io_service object.
      * @param host hostname
      * @param port port number
      * @return client object
      */
-    friend std::shared_ptr<client<as::ip::tcp::socket, as::io_service::strand>>
+    friend std::shared_ptr<client<as::ip::tcp::socket, multi_threaded>>
     make_client(as::io_service& ios, std::string host, std::string port);
 
     /**
-     * @breif Create no tls client without strand.
+     * @breif Create no tls client with strand and without locks. See strand_serialized.
      * @param ios io_service object.
      * @param host hostname
      * @param port port number
      * @return client object
      */
-    friend std::shared_ptr<client<as::ip::tcp::socket, null_strand>>
+    friend std::shared_ptr<client<as::ip::tcp::socket, strand_serialized>>
+    make_client_strand_serialized(as::io_service& ios, std::string host, std::string port);
+
+    /**
+     * @breif Create no tls client without strand and locks. See single_threaded.
+     * @param ios io_service object.
+     * @param host hostname
+     * @param port port number
+     * @return client object
+     */
+    friend std::shared_ptr<client<as::ip::tcp::socket, single_threaded>>
     make_client_no_strand(as::io_service& ios, std::string host, std::string port);
 
 #if !defined(MQTT_NO_TLS)
     /**
-     * @breif Create tls client with strand.
+     * @breif Create tls client with strand and locks. See multi_threaded.
      * @param ios io_service object.
      * @param host hostname
      * @param port port number
      * @return client object
      */
-    friend std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, as::io_service::strand>>
+    friend std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, multi_threaded>>
     make_tls_client(as::io_service& ios, std::string host, std::string port);
 
     /**
-     * @breif Create tls client without strand.
+     * @breif Create tls client with strand and without locks. See strand_serialized.
+     * @param ios io_service object.
+     * @param host hostname
+     * @param port port number
+     * @return client object
+     */
+    friend std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, strand_serialized>>
+    make_tls_client_strand_serialized(as::io_service& ios, std::string host, std::string port);
+
+    /**
+     * @breif Create tls client without strand and locks. See single_threaded.
      * @param ios io_service object.
      * @param host hostname
      * @param port port number
      * @return client object
      */
-    friend std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, null_strand>>
+    friend std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, single_threaded>>
     make_tls_client_no_strand(as::io_service& ios, std::string host, std::string port);
 
     void set_ca_cert_file(std::string file) {
@@ -157,7 +189,7 @@ public:
     void connect(async_handler_t const& func = async_handler_t()) {
         as::ip::tcp::resolver r(ios_);
         as::ip::tcp::resolver::query q(host_, port_);
-        auto it = r.resolve(q);
+        as::ip::tcp::resolver::iterator it = r.resolve(q);
         setup_socket(base::socket());
         auto self = this->shared_from_this();
         as::async_connect(
@@ -192,7 +224,7 @@ public:
     void connect(std::unique_ptr<Socket>&& socket, async_handler_t const& func = async_handler_t()) {
         as::ip::tcp::resolver r(ios_);
         as::ip::tcp::resolver::query q(host_, port_);
-        auto it = r.resolve(q);
+        as::ip::tcp::resolver::iterator it = r.resolve(q);
         base::socket() = std::move(socket);
         auto self = this->shared_from_this();
         as::async_connect(
@@ -245,7 +277,7 @@ private:
            std::string host,
            std::string port,
            bool tls)
-        :endpoint<Socket, Strand>(ios),
+        :base(ios),
          ios_(ios),
          tim_(new boost::asio::deadline_timer(ios_)),
          host_(std::move(host)),
@@ -293,7 +325,7 @@ private:
             [this, self, func]
             (boost::system::error_code const& ec) mutable {
                 if (base::handle_close_or_error(ec)) return;
-                base::async_read_control_packet_type(func);
+                base::async_read_packets(func);
                 base::connect(keep_alive_sec_);
             });
     }
@@ -302,7 +334,7 @@ private:
     typename std::enable_if<
         std::is_same<T, std::unique_ptr<as::ip::tcp::socket>>::value
     >::type handshake_socket(T&, async_handler_t const& func) {
-        base::async_read_control_packet_type(func);
+        base::async_read_packets(func);
         base::connect(keep_alive_sec_);
     }
 
@@ -345,73 +377,106 @@ private:
     error_handler h_error_;
 };
 
-inline std::shared_ptr<client<as::ip::tcp::socket, as::io_service::strand>>
+inline std::shared_ptr<client<as::ip::tcp::socket, multi_threaded>>
 make_client(as::io_service& ios, std::string host, std::string port) {
-    struct impl : client<as::ip::tcp::socket, as::io_service::strand> {
+    struct impl : client<as::ip::tcp::socket, multi_threaded> {
         impl(as::io_service& ios,
              std::string host,
              std::string port,
              bool tls)
-        : client<as::ip::tcp::socket, as::io_service::strand>(ios, std::move(host), std::move(port), tls) {}
+        : client<as::ip::tcp::socket, multi_threaded>(ios, std::move(host), std::move(port), tls) {}
     };
     return std::make_shared<impl>(std::ref(ios), std::move(host), std::move(port), false);
 }
 
-inline std::shared_ptr<client<as::ip::tcp::socket, as::io_service::strand>>
+inline std::shared_ptr<client<as::ip::tcp::socket, multi_threaded>>
 make_client(as::io_service& ios, std::string host, std::uint16_t port) {
     return make_client(ios, std::move(host), boost::lexical_cast<std::string>(port));
 }
 
-inline std::shared_ptr<client<as::ip::tcp::socket, null_strand>>
+inline std::shared_ptr<client<as::ip::tcp::socket, strand_serialized>>
+make_client_strand_serialized(as::io_service& ios, std::string host, std::string port) {
+    struct impl : client<as::ip::tcp::socket, strand_serialized> {
+        impl(as::io_service& ios,
+             std::string host,
+             std::string port,
+             bool tls)
+        : client<as::ip::tcp::socket, strand_serialized>(ios, std::move(host), std::move(port), tls) {}
+    };
+    return std::make_shared<impl>(std::ref(ios), std::move(host), std::move(port), false);
+}
+
+inline std::shared_ptr<client<as::ip::tcp::socket, strand_serialized>>
+make_client_strand_serialized(as::io_service& ios, std::string host, std::uint16_t port) {
+    return make_client_strand_serialized(ios, std::move(host), boost::lexical_cast<std::string>(port));
+}
+
+inline std::shared_ptr<client<as::ip::tcp::socket, single_threaded>>
 make_client_no_strand(as::io_service& ios, std::string host, std::string port) {
-    struct impl : client<as::ip::tcp::socket, null_strand> {
+    struct impl : client<as::ip::tcp::socket, single_threaded> {
         impl(as::io_service& ios,
              std::string host,
              std::string port,
              bool tls)
-        : client<as::ip::tcp::socket, null_strand>(ios, std::move(host), std::move(port), tls) {}
+        : client<as::ip::tcp::socket, single_threaded>(ios, std::move(host), std::move(port), tls) {}
     };
     return std::make_shared<impl>(std::ref(ios), std::move(host), std::move(port), false);
 }
 
-inline std::shared_ptr<client<as::ip::tcp::socket, null_strand>>
+inline std::shared_ptr<client<as::ip::tcp::socket, single_threaded>>
 make_client_no_strand(as::io_service& ios, std::string host, std::uint16_t port) {
     return make_client_no_strand(ios, std::move(host), boost::lexical_cast<std::string>(port));
 }
 
 #if !defined(MQTT_NO_TLS)
 
-inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, as::io_service::strand>>
+inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, multi_threaded>>
 make_tls_client(as::io_service& ios, std::string host, std::string port) {
-    struct impl : client<as::ssl::stream<as::ip::tcp::socket>, as::io_service::strand> {
+    struct impl : client<as::ssl::stream<as::ip::tcp::socket>, multi_threaded> {
         impl(as::io_service& ios,
              std::string host,
              std::string port,
              bool tls)
-        : client<as::ssl::stream<as::ip::tcp::socket>, as::io_service::strand>(ios, std::move(host), std::move(port), tls) {}
+        : client<as::ssl::stream<as::ip::tcp::socket>, multi_threaded>(ios, std::move(host), std::move(port), tls) {}
     };
-    return std::make_shared<impl>
-        (std::ref(ios), std::move(host), std::move(port), true);
+    return std::make_shared<impl>(std::ref(ios), std::move(host), std::move(port), true);
 }
 
-inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, as::io_service::strand>>
+inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, multi_threaded>>
 make_tls_client(as::io_service& ios, std::string host, std::uint16_t port) {
     return make_tls_client(ios, std::move(host), boost::lexical_cast<std::string>(port));
 }
 
-inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, null_strand>>
+inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, strand_serialized>>
+make_tls_client_strand_serialized(as::io_service& ios, std::string host, std::string port) {
+    struct impl : client<as::ssl::stream<as::ip::tcp::socket>, strand_serialized> {
+        impl(as::io_service& ios,
+             std::string host,
+             std::string port,
+             bool tls)
+        : client<as::ssl::stream<as::ip::tcp::socket>, strand_serialized>(ios, std::move(host), std::move(port), tls) {}
+    };
+    return std::make_shared<impl>(std::ref(ios), std::move(host), std::move(port), true);
+}
+
+inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, strand_serialized>>
+make_tls_client_strand_serialized(as::io_service& ios, std::string host, std::uint16_t port) {
+    return make_tls_client_strand_serialized(ios, std::move(host), boost::lexical_cast<std::string>(port));
+}
+
+inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, single_threaded>>
 make_tls_client_no_strand(as::io_service& ios, std::string host, std::string port) {
-    struct impl : client<as::ssl::stream<as::ip::tcp::socket>, null_strand> {
+    struct impl : client<as::ssl::stream<as::ip::tcp::socket>, single_threaded> {
         impl(as::io_service& ios,
              std::string host,
              std::string port,
              bool tls)
-        : client<as::ssl::stream<as::ip::tcp::socket>, null_strand>(ios, std::move(host), std::move(port), tls) {}
+        : client<as::ssl::stream<as::ip::tcp::socket>, single_threaded>(ios, std::move(host), std::move(port), tls) {}
     };
     return std::make_shared<impl>(std::ref(ios), std::move(host), std::move(port), true);
 }
 
-inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, null_strand>>
+inline std::shared_ptr<client<as::ssl::stream<as::ip::tcp::socket>, single_threaded>>
 make_tls_client_no_strand(as::io_service& ios, std::string host, std::uint16_t port) {
     return make_tls_client_no_strand(ios, std::move(host), boost::lexical_cast<std::string>(port));
 }
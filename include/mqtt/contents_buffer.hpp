@@ -0,0 +1,80 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_CONTENTS_BUFFER_HPP)
+#define MQTT_CONTENTS_BUFFER_HPP
+
+#include <string>
+#include <memory>
+#include <utility>
+
+#include <mqtt/string_view.hpp>
+#include <mqtt/shared_buffer.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Contents of the publish packet.
+ *
+ * The publish APIs take the contents as contents_buffer. It is implicitly constructed from
+ * - std::string const& and char const*<BR>
+ *   The contents is referred to. It is copied only if it is kept after the call returns,
+ *   that is, sent by async APIs or stored for resending QoS1 and QoS2.
+ * - std::string&&<BR>
+ *   The contents is moved into the send path without copying.
+ * - std::shared_ptr<std::string const>, std::shared_ptr<std::string>, and shared_buffer<BR>
+ *   The contents is shared without copying. The same contents can be published to several endpoints,
+ *   and a received contents can be published as is.
+ *   The contents must not be modified until the packet is sent and acknowledged.
+ */
+class contents_buffer {
+public:
+    contents_buffer() {}
+
+    contents_buffer(std::string const& s)
+        :view_(s) {}
+
+    contents_buffer(char const* s)
+        :view_(s) {}
+
+    contents_buffer(std::string&& s) {
+        auto sp = std::make_shared<std::string const>(std::move(s));
+        view_ = string_view(*sp);
+        owner_ = std::move(sp);
+    }
+
+    contents_buffer(std::shared_ptr<std::string const> s) {
+        if (!s) return;
+        view_ = string_view(*s);
+        owner_ = std::move(s);
+    }
+
+    contents_buffer(std::shared_ptr<std::string> s)
+        :contents_buffer(std::shared_ptr<std::string const>(std::move(s))) {}
+
+    contents_buffer(shared_buffer const& b)
+        :owner_(b.owner()),
+         view_(b.view()) {}
+
+    char const* data() const { return view_.data(); }
+    std::size_t size() const { return view_.size(); }
+    bool empty() const { return view_.empty(); }
+    string_view view() const { return view_; }
+
+    /**
+     * @brief Get the object that keeps the contents alive.
+     * @return owner, or nullptr if the contents is referred to without ownership
+     */
+    std::shared_ptr<void const> const& owner() const { return owner_; }
+
+private:
+    std::shared_ptr<void const> owner_;
+    string_view view_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_CONTENTS_BUFFER_HPP
@@ -8,6 +8,7 @@
 #define MQTT_ENCODED_LENGTH_HPP
 
 #include <string>
+#include <cstdint>
 
 namespace mqtt {
 
@@ -19,6 +20,29 @@ inline std::string encoded_length(std::string const& str) {
     return result;
 }
 
+/**
+ * @brief Encode the length of the string as 2 bytes big endian into the caller-provided bytes.
+ * @param size length of the string
+ * @param out destination that has at least 2 bytes
+ * @return pointer past the last written byte
+ */
+constexpr char* encode_length(std::size_t size, char* out) {
+    out[0] = static_cast<char>(size >> 8);
+    out[1] = static_cast<char>(size & 0xff);
+    return out + 2;
+}
+
+/**
+ * @brief Decode the 2 bytes big endian length.
+ * @param p top of the length that has at least 2 bytes
+ * @return length
+ */
+constexpr std::uint16_t decode_length(char const* p) {
+    return static_cast<std::uint16_t>(
+        (static_cast<std::uint16_t>(p[0]) & 0xff) << 8 |
+        (static_cast<std::uint16_t>(p[1]) & 0xff));
+}
+
 } // namespace mqtt
 
 #endif // MQTT_ENCODED_LENGTH_HPP
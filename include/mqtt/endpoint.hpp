@@ -8,24 +8,24 @@
 #define MQTT_ENDPOINT_HPP
 
 #include <string>
+#include <array>
 #include <vector>
 #include <deque>
 #include <functional>
 #include <set>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
+#include <cstring>
+#include <algorithm>
 
 #include <boost/any.hpp>
 #include <boost/optional.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/composite_key.hpp>
 #include <boost/system/error_code.hpp>
 
 #include <mqtt/fixed_header.hpp>
@@ -39,11 +39,24 @@
 #include <mqtt/publish.hpp>
 #include <mqtt/connect_return_code.hpp>
 #include <mqtt/exception.hpp>
+#include <mqtt/string_view.hpp>
+#include <mqtt/shared_buffer.hpp>
+#include <mqtt/contents_buffer.hpp>
+#include <mqtt/topic_handle.hpp>
+#include <mqtt/try_publish_status.hpp>
+#include <mqtt/buffer_pool.hpp>
+#include <mqtt/send_buffer_pool.hpp>
+#include <mqtt/send_queue_policy.hpp>
+#include <mqtt/flat_store.hpp>
+#include <mqtt/packet_id_allocator.hpp>
+#include <mqtt/null_mutex.hpp>
+#include <mqtt/null_atomic.hpp>
+#include <mqtt/session_store.hpp>
+#include <mqtt/packet_parser.hpp>
 
 namespace mqtt {
 
 namespace as = boost::asio;
-namespace mi = boost::multi_index;
 
 template <typename Socket, typename Strand, typename Mutex = std::mutex, template<typename...> class LockGuard = std::lock_guard>
 class endpoint : public std::enable_shared_from_this<endpoint<Socket, Strand, Mutex, LockGuard>> {
@@ -51,6 +64,10 @@ class endpoint : public std::enable_shared_from_this<endpoint<Socket, Strand, Mu
 public:
     using async_handler_t = std::function<void(boost::system::error_code const& ec)>;
 
+    static constexpr std::size_t const default_read_buffer_size = 16 * 1024;
+    static constexpr std::size_t const default_max_coalesced_packets = 64;
+    static constexpr std::size_t const default_max_coalesced_bytes = 64 * 1024;
+
     /**
      * @brief Constructor for client
      */
@@ -58,9 +75,42 @@ public:
         :strand_(ios),
          connected_(false),
          clean_session_(false),
-         packet_id_master_(0),
+         read_begin_(0),
+         read_end_(0),
+         read_required_(0),
+         read_buffer_size_(default_read_buffer_size),
+         read_buffer_pool_(default_read_buffer_size),
+         chunk_deliver_(false),
+         chunk_qos_(0),
+         memory_budget_(std::numeric_limits<std::size_t>::max()),
+         read_buffer_shrink_(true),
+         utf8_check_send_(true),
+         max_coalesced_packets_(default_max_coalesced_packets),
+         max_coalesced_bytes_(default_max_coalesced_bytes),
+         batching_(false),
+         read_buffer_bytes_(0),
+         queued_bytes_(0),
+         stored_bytes_(0),
+         high_queued_bytes_(std::numeric_limits<std::size_t>::max()),
+         low_queued_bytes_(std::numeric_limits<std::size_t>::max()),
+         high_queued_count_(std::numeric_limits<std::size_t>::max()),
+         low_queued_count_(std::numeric_limits<std::size_t>::max()),
+         send_queue_policy_(send_queue_policy::reject),
+         queued_count_(0),
+         send_queue_high_(false),
+         waiting_publishers_(0),
+         control_packet_priority_(true),
+         linger_bytes_(default_max_coalesced_bytes),
+         max_inflight_(0),
+         inflight_full_(false),
+         queue_(mqtt::send_buffer_pool::allocator<async_packet>(send_buffer_pool_)),
+         control_count_(0),
+         lingering_(false),
+         linger_timer_(ios),
          auto_pub_response_(true),
-         auto_pub_response_async_(false)
+         auto_pub_response_async_(false),
+         async_resend_(false),
+         resending_(false)
     {}
 
     /**
@@ -72,9 +122,42 @@ public:
          socket_(std::move(socket)),
          connected_(true),
          clean_session_(false),
-         packet_id_master_(0),
+         read_begin_(0),
+         read_end_(0),
+         read_required_(0),
+         read_buffer_size_(default_read_buffer_size),
+         read_buffer_pool_(default_read_buffer_size),
+         chunk_deliver_(false),
+         chunk_qos_(0),
+         memory_budget_(std::numeric_limits<std::size_t>::max()),
+         read_buffer_shrink_(true),
+         utf8_check_send_(true),
+         max_coalesced_packets_(default_max_coalesced_packets),
+         max_coalesced_bytes_(default_max_coalesced_bytes),
+         batching_(false),
+         read_buffer_bytes_(0),
+         queued_bytes_(0),
+         stored_bytes_(0),
+         high_queued_bytes_(std::numeric_limits<std::size_t>::max()),
+         low_queued_bytes_(std::numeric_limits<std::size_t>::max()),
+         high_queued_count_(std::numeric_limits<std::size_t>::max()),
+         low_queued_count_(std::numeric_limits<std::size_t>::max()),
+         send_queue_policy_(send_queue_policy::reject),
+         queued_count_(0),
+         send_queue_high_(false),
+         waiting_publishers_(0),
+         control_packet_priority_(true),
+         linger_bytes_(default_max_coalesced_bytes),
+         max_inflight_(0),
+         inflight_full_(false),
+         queue_(mqtt::send_buffer_pool::allocator<async_packet>(send_buffer_pool_)),
+         control_count_(0),
+         lingering_(false),
+         linger_timer_(socket_->get_io_service()),
          auto_pub_response_(true),
-         auto_pub_response_async_(false)
+         auto_pub_response_async_(false),
+         async_resend_(false),
+         resending_(false)
     {}
 
     /**
@@ -169,6 +252,92 @@ public:
                                                std::string topic_name,
                                                std::string contents)>;
 
+    /**
+     * @breif Publish view handler
+     * @param fixed_header
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1 Fixed header<BR>
+     *        You can check the fixed header using mqtt::publish functions.
+     * @param packet_id
+     *        packet identifier<BR>
+     *        If received publish's QoS is 0, packet_id is boost::none.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718039<BR>
+     *        3.3.2  Variable header
+     * @param topic_name
+     *        Topic name. It refers to the receive buffer.
+     * @param contents
+     *        Published contents. It refers to the receive buffer.
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     *
+     * topic_name and contents are valid only until the handler returns.
+     * If you want to keep them, call to_string() to retain the copy.
+     */
+    using publish_view_handler = std::function<bool(std::uint8_t fixed_header,
+                                                    boost::optional<std::uint16_t> packet_id,
+                                                    string_view topic_name,
+                                                    string_view contents)>;
+
+    /**
+     * @breif Publish buffer handler
+     * @param fixed_header
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1 Fixed header<BR>
+     *        You can check the fixed header using mqtt::publish functions.
+     * @param packet_id
+     *        packet identifier<BR>
+     *        If received publish's QoS is 0, packet_id is boost::none.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718039<BR>
+     *        3.3.2  Variable header
+     * @param topic_name
+     *        Topic name. It is a reference counted slice of the receive buffer.
+     * @param contents
+     *        Published contents. It is a reference counted slice of the receive buffer.
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     *
+     * topic_name and contents can be kept after the handler returns, for example,
+     * to pass them to another thread without copying.
+     */
+    using publish_buffer_handler = std::function<bool(std::uint8_t fixed_header,
+                                                      boost::optional<std::uint16_t> packet_id,
+                                                      shared_buffer topic_name,
+                                                      shared_buffer contents)>;
+
+    /**
+     * @breif Publish begin handler
+     *        This handler is called when a chunked publish is received.
+     * @param fixed_header
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1 Fixed header<BR>
+     *        You can check the fixed header using mqtt::publish functions.
+     * @param packet_id
+     *        packet identifier<BR>
+     *        If received publish's QoS is 0, packet_id is boost::none.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718039<BR>
+     *        3.3.2  Variable header
+     * @param topic_name
+     *        Topic name. It is valid until the handler returns.
+     * @param contents_size
+     *        The total size of the contents that are delivered to the publish chunk handler.
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     */
+    using publish_begin_handler = std::function<bool(std::uint8_t fixed_header,
+                                                     boost::optional<std::uint16_t> packet_id,
+                                                     string_view topic_name,
+                                                     std::size_t contents_size)>;
+
+    /**
+     * @breif Publish chunk handler
+     *        This handler is called for each part of the contents of a chunked publish.
+     * @param chunk
+     *        A part of the contents. It is valid until the handler returns.
+     * @param last
+     *        true if the chunk is the last part of the contents.
+     * @return if the handler returns true, then continue receiving, otherwise quit.
+     *
+     * puback or pubrec is sent after the last chunk is handled.
+     */
+    using publish_chunk_handler = std::function<bool(string_view chunk, bool last)>;
+
     /**
      * @breif Puback handler
      * @param packet_id
@@ -219,6 +388,26 @@ public:
      */
     using pub_res_sent_handler = std::function<void(std::uint16_t packet_id)>;
 
+    /**
+     * @breif Send queue high handler
+     *        This function is called when the async send queue reaches the high watermark.
+     */
+    using send_queue_high_handler = std::function<void()>;
+
+    /**
+     * @breif Send queue low handler
+     *        This function is called when the async send queue falls to the low watermark
+     *        after it has reached the high watermark.
+     */
+    using send_queue_low_handler = std::function<void()>;
+
+    /**
+     * @breif In-flight room handler
+     *        This function is called when the in-flight window has room again
+     *        after it has been full. See set_max_inflight().
+     */
+    using inflight_room_handler = std::function<void()>;
+
     /**
      * @breif Subscribe handler
      * @param packet_id packet identifier<BR>
@@ -366,6 +555,383 @@ public:
         auto_pub_response_async_ = async;
     }
 
+    /**
+     * @breif Set the receive buffer size.
+     * @param size receive buffer size in bytes
+     *
+     * Received bytes are read into the receive buffer as much as possible at once,
+     * and all complete packets in the buffer are handled before the next read.<BR>
+     * If a packet is bigger than the receive buffer, the buffer is extended to the packet size.<BR>
+     * The default size is 16KiB.
+     */
+    void set_read_buffer_size(std::size_t size) {
+        // At least the fixed header and the longest remaining length bytes should be stored.
+        read_buffer_size_ = std::max<std::size_t>(size, 5);
+        read_buffer_pool_.set_buffer_size(read_buffer_size_);
+    }
+
+    /**
+     * @breif Get the receive buffer pool.
+     * @return receive buffer pool
+     *
+     * When the publish buffer handler retains the received topic name or contents,
+     * the next packets are received into another buffer acquired from the pool.
+     * The retained buffer goes back to the pool when the last reference is dropped.<BR>
+     * You can check the pool hit and miss counts, and set the maximum number of pooled buffers.
+     */
+    buffer_pool& read_buffer_pool() {
+        return read_buffer_pool_;
+    }
+
+    buffer_pool const& read_buffer_pool() const {
+        return read_buffer_pool_;
+    }
+
+    /**
+     * @breif Get the send buffer pool.
+     * @return send buffer pool
+     *
+     * The send buffers, the payloads copied by async publish, and the nodes of the async send queue
+     * are recycled by the pool.<BR>
+     * You can check the pool hit and miss counts and the outstanding bytes,
+     * and set the maximum bytes of the pooled buffers.
+     */
+    mqtt::send_buffer_pool& send_buffer_pool() {
+        return send_buffer_pool_;
+    }
+
+    mqtt::send_buffer_pool const& send_buffer_pool() const {
+        return send_buffer_pool_;
+    }
+
+    /**
+     * @breif Set the maximum size of incoming packets.
+     * @param size maximum packet size in bytes including the fixed header and the remaining length
+     *
+     * The size is checked just after the remaining length is decoded, before any byte of
+     * the packet body is buffered.<BR>
+     * When a packet exceeds the size, the connection is closed and the error handler is called
+     * with boost::system::errc::message_size.<BR>
+     * Publish packets delivered by the publish chunk handlers are not limited because they are
+     * never stored as a whole.<BR>
+     * The default is unlimited.
+     */
+    void set_max_packet_size(std::size_t size) {
+        parser_.set_max_packet_size(size);
+    }
+
+    std::size_t max_packet_size() const {
+        return parser_.max_packet_size();
+    }
+
+    /**
+     * @breif Set the memory budget of the endpoint.
+     * @param size budget in bytes
+     *
+     * The budget covers the receive buffer, the packets waiting in the async send queue,
+     * and the packets stored for the QoS1 and QoS2 sequences.<BR>
+     * When the receive buffer would be extended for a packet, or an async packet would be queued,
+     * beyond the budget, the connection is closed and the error handler is called
+     * with boost::system::errc::no_buffer_space.<BR>
+     * Stored packets are never dropped to fit the budget, but they reduce the room left for the others.<BR>
+     * A packet that is both queued and stored is counted twice.<BR>
+     * The default is unlimited.
+     */
+    void set_memory_budget(std::size_t size) {
+        memory_budget_ = size;
+    }
+
+    std::size_t memory_budget() const {
+        return memory_budget_;
+    }
+
+    /**
+     * @breif Get the memory usage of the endpoint.
+     * @return bytes of the receive buffer, the async send queue, and the stored packets
+     */
+    std::size_t memory_usage() const {
+        return read_buffer_bytes_ + queued_bytes_ + stored_bytes_;
+    }
+
+    /**
+     * @breif Set UTF-8 encoded string validation.
+     * @param send
+     *        If true, the strings in the sending packets are validated.
+     *        If a string is invalid, utf8string_contents_error is thrown.
+     * @param receive
+     *        If true, the strings in the received packets are validated.
+     *        If a string is invalid, the connection is closed and the error handler is called
+     *        with boost::system::errc::illegal_byte_sequence.
+     *
+     * The topic names, the topic filters, the client id, the will topic, and the user name are validated.<BR>
+     * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718016<BR>
+     * 1.5.3 UTF-8 encoded strings<BR>
+     * The default is true for both directions.
+     */
+    void set_utf8_check(bool send = true, bool receive = true) {
+        utf8_check_send_ = send;
+        parser_.set_utf8_check(receive);
+    }
+
+    /**
+     * @breif Set the receive buffer shrink policy.
+     * @param b If true, the receive buffer is shrunk to the receive buffer size
+     *          after a packet bigger than the size is handled.
+     *          If false, the extended receive buffer is kept and reused.
+     *
+     * The default is true.
+     */
+    void set_read_buffer_shrink(bool b = true) {
+        read_buffer_shrink_ = b;
+    }
+
+    /**
+     * @breif Set the limits of the write coalescing.
+     * @param max_packets maximum number of the queued packets that are written at once
+     * @param max_bytes maximum bytes that are written at once
+     *
+     * The packets sent by async APIs are queued while the previous write is in progress.
+     * The queued packets are gathered and written by one async_write(), and then
+     * their handlers are called in order.<BR>
+     * At least one packet is written even if it is bigger than max_bytes.
+     * If max_packets is 1, the coalescing is disabled.<BR>
+     * The default is 64 packets and 64KiB.
+     */
+    void set_write_coalescing(std::size_t max_packets, std::size_t max_bytes) {
+        max_coalesced_packets_ = std::max<std::size_t>(max_packets, 1);
+        max_coalesced_bytes_ = max_bytes;
+    }
+
+    /**
+     * @breif Set the priority of the control packets in the async send queue.
+     * @param b If true, PUBACK, PUBREC, PUBREL, PUBCOMP, PINGREQ, and PINGRESP are queued
+     *          ahead of the other packets that are not being written yet.
+     *
+     * The control packets are written in order among themselves, at the next packet boundary,
+     * so keep alive and acknowledgements are not delayed by a large backlog of publishes.
+     * A packet that is being written is never interrupted.<BR>
+     * The default is true.
+     */
+    void set_control_packet_priority(bool b = true) {
+        control_packet_priority_ = b;
+    }
+
+    /**
+     * @breif Set the watermarks of the async send queue.
+     * @param high_bytes the queue is high when the queued bytes reach it
+     * @param low_bytes the queue is low again when the queued bytes fall to it
+     * @param high_count the queue is high when the number of queued packets reaches it
+     * @param low_count the queue is low again when the number of queued packets falls to it
+     *
+     * The queue is high when either the bytes or the count reaches the high watermark,
+     * and it is low again when both of them fall to the low watermarks.
+     * The low watermarks should be less than the high watermarks.<BR>
+     * The send queue high handler and the send queue low handler are called on the crossings.
+     * While the queue is high, async publishes are handled by the policy set by set_send_queue_policy().
+     * The other packets such as PUBACK and PINGREQ are always queued.<BR>
+     * The default is unlimited.
+     */
+    void set_send_queue_watermarks(
+        std::size_t high_bytes,
+        std::size_t low_bytes,
+        std::size_t high_count = std::numeric_limits<std::size_t>::max(),
+        std::size_t low_count = std::numeric_limits<std::size_t>::max()) {
+        high_queued_bytes_ = high_bytes;
+        low_queued_bytes_ = low_bytes;
+        high_queued_count_ = high_count;
+        low_queued_count_ = low_count;
+    }
+
+    /**
+     * @breif Set the policy of the async publish while the async send queue is high.
+     * @param policy send_queue_policy
+     *
+     * The default is send_queue_policy::reject.
+     */
+    void set_send_queue_policy(send_queue_policy policy) {
+        send_queue_policy_ = policy;
+    }
+
+    /**
+     * @breif Get the bytes of the packets in the async send queue.
+     * @return queued bytes
+     */
+    std::size_t queued_bytes() const {
+        return queued_bytes_;
+    }
+
+    /**
+     * @breif Get the number of the packets in the async send queue.
+     * @return number of queued packets
+     */
+    std::size_t queued_count() const {
+        return queued_count_;
+    }
+
+    /**
+     * @breif Check whether the async send queue is high.
+     * @return true if the queue has reached the high watermark and not fallen to the low watermark yet
+     */
+    bool send_queue_high() const {
+        return send_queue_high_;
+    }
+
+    /**
+     * @breif Set the maximum number of the QoS1 and QoS2 publishes in flight.
+     * @param max_inflight the maximum number of the publishes in flight. 0 means unlimited.
+     *
+     * A publish is in flight from it is sent until PUBACK (QoS1) or PUBCOMP (QoS2) is received.
+     * The publishes beyond the window are not sent but queued locally with their packet ids,
+     * and sent in order when PUBACK or PUBCOMP makes room. They are also sent after CONNACK
+     * when the window has room.<BR>
+     * The publish functions return as usual. The async handler is called when the queued publish is written.
+     * The in-flight room handler is called when the window has room again after it has been full.<BR>
+     * The queued publishes hold their packet ids. The ones of the async APIs are counted in the async send queue,
+     * so they are limited by set_send_queue_watermarks() and set_memory_budget(). If the budget would be exceeded,
+     * the publish is rejected and its handler is called with boost::system::errc::no_buffer_space.
+     * The ones of the blocking APIs are counted as the stored packets in memory_usage().<BR>
+     * The publishes with the dup flag are resends, so they are sent regardless of the window.<BR>
+     * The default is 0.
+     */
+    void set_max_inflight(std::size_t max_inflight) {
+        max_inflight_ = max_inflight;
+    }
+
+    /**
+     * @breif Set the resend mode of the stored packets on CONNACK.
+     * @param async if true, the stored packets are resent by the async send queue.
+     *
+     * On CONNACK of the session that is not clean, the stored packets are gathered by the limits of
+     * set_write_coalescing(), and written without locking the stored packets.<BR>
+     * If async is true, the packets are queued to the async send queue while it is under the high watermark
+     * of set_send_queue_watermarks(), and the rest is queued when the queued packets are written.
+     * The CONNACK handler is called without waiting for the resend, so the packets sent from it
+     * can be written before the rest of the resend. Use it when the packets are sent by async APIs.<BR>
+     * If async is false, the packets are written by blocking writes before the CONNACK handler is called.<BR>
+     * The publishes queued by the in-flight window are sent after the resend.<BR>
+     * The default is false.
+     */
+    void set_async_resend(bool async = true) {
+        async_resend_ = async;
+    }
+
+    /**
+     * @breif Set the persistent store of the QoS1 and QoS2 packets in flight.
+     * @param store session store
+     *
+     * The packets stored in store are recovered to the endpoint, and resent on CONNACK
+     * if the session is not clean. After that, the packets that wait for PUBACK, PUBREC, or PUBCOMP
+     * are added to store before they are sent, and removed from it when they are completed.<BR>
+     * If store throws on a publish, the publish is not sent, its packet id is released,
+     * and the exception is thrown to the caller.<BR>
+     * The publishes queued by the in-flight window of set_max_inflight() are not stored
+     * until they are sent.<BR>
+     * Call it before connecting. If it is not set, the packets are kept only in memory.
+     */
+    void set_session_store(std::shared_ptr<session_store> store) {
+        LockGuard<Mutex> lck (store_mtx_);
+        if (store) {
+            store->for_each(
+                [this]
+                (std::uint16_t packet_id, std::uint8_t expected_control_packet_type, std::string packet) {
+                    auto buf = std::make_shared<std::string>(std::move(packet));
+                    auto ret = store_.emplace(
+                        packet_id, packet_id, expected_control_packet_type, buf, &(*buf)[0], buf->size());
+                    if (!ret.second) return;
+                    stored_bytes_ += ret.first->size();
+                    register_packet_id(packet_id);
+                    inflight_.reserve(packet_id);
+                }
+            );
+        }
+        session_store_ = std::move(store);
+    }
+
+    /**
+     * @breif Get the number of the QoS1 and QoS2 publishes in flight.
+     * @return number of the publishes in flight. The queued publishes are not included.
+     */
+    std::size_t inflight_count() const {
+        return inflight_.size();
+    }
+
+    /**
+     * @breif Set the linger of the async sends.
+     * @param delay maximum time that a packet waits for the following packets
+     * @param bytes the packets are written without waiting when the queued bytes reach it
+     *
+     * When a packet is queued while no write is in progress, the write is delayed up to delay,
+     * so a burst of small publishes is written by one write. The packets that are queued while
+     * a write is in progress are written just after the write as before.<BR>
+     * The control packets such as PUBACK and PINGREQ are written without waiting
+     * if the control packet priority is enabled.<BR>
+     * If delay is zero, the linger is disabled. The default is disabled.
+     */
+    void set_write_linger(
+        boost::posix_time::time_duration delay,
+        std::size_t bytes = default_max_coalesced_bytes) {
+        linger_delay_ = delay;
+        linger_bytes_ = bytes;
+    }
+
+    /**
+     * @breif Start the batch of the blocking sends.
+     *
+     * While the batch is open, the packets sent by the blocking APIs, including the automatic
+     * responses and the resent packets, are appended to the batch buffer instead of being written.
+     * They are written by one write on flush().<BR>
+     * The batch is shared by the threads. If it is opened on another thread than the one that handles
+     * the received packets, the automatic responses such as PUBACK are also held until flush().
+     * The batch buffer is locked by the mutex of the endpoint unless it is null_mutex.<BR>
+     * If the batch buffer would exceed the bytes limit of set_write_coalescing(),
+     * the buffer is written before appending.<BR>
+     * The errors of the batched packets are reported on the write of the buffer.
+     */
+    void begin_batch() {
+        LockGuard<Mutex> lck (batch_mtx_);
+        batching_ = true;
+    }
+
+    /**
+     * @breif Write the batched packets, and finish the batch.
+     */
+    void flush() {
+        boost::system::error_code ec;
+        {
+            LockGuard<Mutex> lck (batch_mtx_);
+            batching_ = false;
+            write_batch(ec);
+        }
+        if (ec) handle_error(ec);
+    }
+
+    /**
+     * @breif Check whether the batch is open.
+     * @return true if the batch is open
+     */
+    bool batching() const {
+        LockGuard<Mutex> lck (batch_mtx_);
+        return batching_;
+    }
+
+    /**
+     * @breif Scoped batch of the blocking sends.
+     *        begin_batch() is called on construction, and flush() is called on destruction.
+     */
+    class batch {
+    public:
+        explicit batch(endpoint& ep):ep_(ep) {
+            ep_.begin_batch();
+        }
+        ~batch() {
+            ep_.flush();
+        }
+        batch(batch const&) = delete;
+        batch& operator=(batch const&) = delete;
+    private:
+        endpoint& ep_;
+    };
+
     /**
      * @brief Set close handler
      * @param h handler
@@ -406,6 +972,44 @@ public:
         h_publish_ = std::move(h);
     }
 
+    /**
+     * @brief Set publish view handler
+     * @param h handler
+     *
+     * If the publish view handler is set, it is called instead of the publish handler.
+     * The topic name and the contents are passed without copying.
+     */
+    void set_publish_view_handler(publish_view_handler h) {
+        h_publish_view_ = std::move(h);
+    }
+
+    /**
+     * @brief Set publish buffer handler
+     * @param h handler
+     *
+     * If the publish buffer handler is set, it is called instead of the publish handler
+     * and the publish view handler.
+     */
+    void set_publish_buffer_handler(publish_buffer_handler h) {
+        h_publish_buffer_ = std::move(h);
+    }
+
+    /**
+     * @brief Set publish chunk handlers
+     * @param begin handler that is called with the topic name before the contents
+     * @param chunk handler that is called with each part of the contents
+     *
+     * If both handlers are set, a publish packet that is bigger than the receive buffer size
+     * is not stored as a whole. The topic name is passed to the begin handler first,
+     * and then the contents are passed to the chunk handler as they arrive.
+     * Each chunk is no bigger than the receive buffer size.<BR>
+     * Publish packets that fit in the receive buffer are passed to the publish handlers as usual.
+     */
+    void set_publish_chunk_handlers(publish_begin_handler begin, publish_chunk_handler chunk) {
+        h_publish_begin_ = std::move(begin);
+        h_publish_chunk_ = std::move(chunk);
+    }
+
     /**
      * @brief Set puback handler
      * @param h handler
@@ -446,6 +1050,30 @@ public:
         h_pub_res_sent_ = std::move(h);
     }
 
+    /**
+     * @brief Set send queue high handler
+     * @param h handler
+     */
+    void set_send_queue_high_handler(send_queue_high_handler h) {
+        h_send_queue_high_ = std::move(h);
+    }
+
+    /**
+     * @brief Set send queue low handler
+     * @param h handler
+     */
+    void set_send_queue_low_handler(send_queue_low_handler h) {
+        h_send_queue_low_ = std::move(h);
+    }
+
+    /**
+     * @brief Set in-flight room handler
+     * @param h handler
+     */
+    void set_inflight_room_handler(inflight_room_handler h) {
+        h_inflight_room_ = std::move(h);
+    }
+
     /**
      * @brief Set subscribe handler
      * @param h handler
@@ -508,7 +1136,7 @@ public:
      *
      */
     void start_session(async_handler_t const& func = async_handler_t()) {
-        async_read_control_packet_type(func);
+        async_read_packets(func);
     }
 
     // Blocking APIs
@@ -516,17 +1144,17 @@ public:
     /**
      * @brief Publish QoS0
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
     void publish_at_most_once(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false) {
         send_publish(topic_name, qos::at_most_once, retain, false, 0, contents);
     }
@@ -534,9 +1162,9 @@ public:
     /**
      * @brief Publish QoS1
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -545,8 +1173,8 @@ public:
      * packet_id is automatically generated.
      */
     std::uint16_t publish_at_least_once(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false) {
         std::uint16_t packet_id = acquire_unique_packet_id();
         send_publish(topic_name, qos::at_least_once, retain, false, packet_id, contents);
@@ -556,9 +1184,9 @@ public:
     /**
      * @brief Publish QoS2
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -567,8 +1195,8 @@ public:
      * packet_id is automatically generated.
      */
     std::uint16_t publish_exactly_once(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false) {
         std::uint16_t packet_id = acquire_unique_packet_id();
         send_publish(topic_name, qos::exactly_once, retain, false, packet_id, contents);
@@ -578,9 +1206,9 @@ public:
     /**
      * @brief Publish
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -591,8 +1219,8 @@ public:
      * packet_id is automatically generated.
      */
     std::uint16_t publish(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
         std::uint16_t packet_id = qos == 0 ? 0 : acquire_unique_packet_id();
@@ -721,9 +1349,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -733,8 +1361,8 @@ public:
      */
     bool publish_at_least_once(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false) {
         if (register_packet_id(packet_id)) {
             send_publish(topic_name, qos::at_least_once, retain, false, packet_id, contents);
@@ -748,9 +1376,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -760,8 +1388,8 @@ public:
      */
     bool publish_exactly_once(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false) {
         if (register_packet_id(packet_id)) {
             send_publish(topic_name, qos::exactly_once, retain, false, packet_id, contents);
@@ -775,9 +1403,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -789,8 +1417,8 @@ public:
      */
     bool publish(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
         if (register_packet_id(packet_id)) {
@@ -805,9 +1433,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -819,8 +1447,8 @@ public:
      */
     bool publish_dup(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false) {
         if (register_packet_id(packet_id)) {
@@ -994,28 +1622,66 @@ public:
     /**
      * @brief Publish QoS0
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
      *        3.3.1.3 RETAIN
      */
     void async_publish_at_most_once(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
         async_send_publish(topic_name, qos::at_most_once, retain, false, 0, contents, func);
     }
 
+    /**
+     * @brief Publish QoS0 if it can be queued immediately
+     * @param topic_name
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
+     * @param contents
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
+     * @param retain
+     *        A retain flag. If set it to true, the contents is retained.<BR>
+     *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
+     *        3.3.1.3 RETAIN
+     * @param func
+     *        The handler that is called when the publish is written. It is not called if the publish is dropped.
+     * @return try_publish_status
+     *
+     * The publish is dropped without blocking if the endpoint is not connected, the async send queue is high
+     * or has reached the high watermark,
+     * or the publish would exceed the memory budget. The send queue policy is not applied.<BR>
+     * The dropping path neither throws nor allocates memory. Pass the contents by a reference or
+     * a shared pointer, because moving a string into contents_buffer allocates on the call site.<BR>
+     * If topic_name is a string, it is validated only if the publish is queued,
+     * and utf8string_length_error or utf8string_contents_error can be thrown.
+     */
+    try_publish_status try_async_publish_at_most_once(
+        topic_view topic_name,
+        contents_buffer contents,
+        bool retain = false,
+        async_handler_t const& func = async_handler_t()) {
+        if (!connected_) return try_publish_status::not_connected;
+        // Fixed header, remaining length, and topic name length.
+        std::size_t size = 1 + 4 + 2 + topic_name.name().size() + contents.size();
+        // The queue could be over the high watermark before the strand notices it.
+        if (send_queue_high_ || over_high_watermark() || memory_usage() + size > memory_budget_) {
+            return try_publish_status::queue_full;
+        }
+        async_queue_publish(topic_name, qos::at_most_once, retain, false, 0, contents, func);
+        return try_publish_status::queued;
+    }
+
     /**
      * @brief Publish QoS1
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -1024,8 +1690,8 @@ public:
      * packet_id is automatically generated.
      */
     std::uint16_t async_publish_at_least_once(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
         std::uint16_t packet_id = acquire_unique_packet_id();
@@ -1036,9 +1702,9 @@ public:
     /**
      * @brief Publish QoS2
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -1047,8 +1713,8 @@ public:
      * packet_id is automatically generated.
      */
     std::uint16_t async_publish_exactly_once(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
         std::uint16_t packet_id = acquire_unique_packet_id();
@@ -1059,9 +1725,9 @@ public:
     /**
      * @brief Publish
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -1072,8 +1738,8 @@ public:
      * packet_id is automatically generated.
      */
     std::uint16_t async_publish(
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
@@ -1195,9 +1861,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -1207,8 +1873,8 @@ public:
      */
     bool async_publish_at_least_once(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
@@ -1223,9 +1889,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param retain
      *        A retain flag. If set it to true, the contents is retained.<BR>
      *        See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718038<BR>
@@ -1235,8 +1901,8 @@ public:
      */
     bool async_publish_exactly_once(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
         if (register_packet_id(packet_id)) {
@@ -1251,9 +1917,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -1265,8 +1931,8 @@ public:
      */
     bool async_publish(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
@@ -1282,9 +1948,9 @@ public:
      * @param packet_id
      *        packet identifier
      * @param topic_name
-     *        A topic name to publish
+     *        A topic name to publish. A topic_handle can be passed to skip validating and encoding it.
      * @param contents
-     *        The contents to publish
+     *        The contents to publish. It can be moved or shared without copying. See contents_buffer.
      * @param qos
      *        mqtt::qos
      * @param retain
@@ -1296,8 +1962,8 @@ public:
      */
     bool async_publish_dup(
         std::uint16_t packet_id,
-        std::string const& topic_name,
-        std::string const& contents,
+        topic_view topic_name,
+        contents_buffer contents,
         std::uint8_t qos = qos::at_most_once,
         bool retain = false,
         async_handler_t const& func = async_handler_t()) {
@@ -1507,11 +2173,13 @@ public:
     }
 
     void clear_stored_publish(std::uint16_t packet_id) {
-        LockGuard<Mutex> lck (store_mtx_);
-        auto& idx = store_.template get<tag_packet_id>();
-        auto r = idx.equal_range(packet_id);
-        idx.erase(std::get<0>(r), std::get<1>(r));
-        packet_id_.erase(packet_id);
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            erase_stored(packet_id);
+            release_packet_id(packet_id);
+            inflight_.release(packet_id);
+        }
+        send_waiting_publishes();
     }
 
     std::unique_ptr<Socket>& socket() {
@@ -1524,18 +2192,52 @@ public:
     template <typename F>
     void for_each_store(F f) {
         LockGuard<Mutex> lck (store_mtx_);
-        auto& idx = store_.template get<tag_seq>();
-        for (auto const & e : idx) {
-            f(e.ptr(), e.size());
+        for (auto const & e : store_) {
+            if (!e.payload().empty()) {
+                // The payload is held apart from the header, so join them.
+                std::string s(e.ptr(), e.header_size());
+                s.append(e.payload().data(), e.payload().size());
+                f(&s[0], s.size());
+            }
+            else {
+                f(e.ptr(), e.size());
+            }
         }
     }
 
 protected:
-    void async_read_control_packet_type(async_handler_t const& func) {
+    /**
+     * @brief Start receiving packets.
+     * @param func finish handler that is called when the session is finished
+     *
+     * Received bytes are accumulated in the receive buffer using async_read_some().
+     * All complete packets in the buffer are handled in a row, and the socket is read
+     * again only when the buffer doesn't contain a complete packet.
+     */
+    void async_read_packets(async_handler_t const& func) {
+        std::size_t unparsed = read_end_ - read_begin_;
+        std::size_t required = std::max(read_required_, read_buffer_size_);
+        if (!read_buf_ ||
+            read_buf_.use_count() != 1 ||
+            read_buf_->size() < required ||
+            (read_buffer_shrink_ && read_buf_->size() > required)) {
+            // The current buffer is too small or too big, or its slices are retained by the application.
+            // Move the truncated packet to a new buffer.
+            auto buf = read_buffer_pool_.acquire(required);
+            if (unparsed != 0) std::memcpy(buf->data(), read_buf_->data() + read_begin_, unparsed);
+            read_buf_ = std::move(buf);
+            read_buffer_bytes_ = read_buf_->size();
+        }
+        else if (read_begin_ != 0 && unparsed != 0) {
+            // Move the truncated packet to the top of the receive buffer.
+            std::memmove(read_buf_->data(), read_buf_->data() + read_begin_, unparsed);
+        }
+        read_begin_ = 0;
+        read_end_ = unparsed;
+        read_required_ = 0;
         auto self = this->shared_from_this();
-        as::async_read(
-            *socket_,
-            as::buffer(&buf_, 1),
+        socket_->async_read_some(
+            as::buffer(read_buf_->data() + read_end_, read_buf_->size() - read_end_),
             [this, self, func](
                 boost::system::error_code const& ec,
                 std::size_t bytes_transferred){
@@ -1543,11 +2245,8 @@ protected:
                     if (func) func(ec);
                     return;
                 }
-                if (bytes_transferred != 1) {
-                    if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                    return;
-                }
-                handle_control_packet_type(func);
+                read_end_ += bytes_transferred;
+                handle_received_bytes(func);
             }
         );
     }
@@ -1759,7 +2458,15 @@ private:
 
     class send_buffer {
     public:
-        send_buffer():buf_(std::make_shared<std::string>(static_cast<int>(payload_position_), 0)) {}
+        /**
+         * @brief Constructor
+         * @param pool pool that the buffer is acquired from
+         * @param size expected size of the variable header and the payload
+         */
+        explicit send_buffer(mqtt::send_buffer_pool& pool, std::size_t size = 0)
+            :buf_(pool.acquire(payload_position_ + size)) {
+            buf_->resize(payload_position_);
+        }
 
         std::shared_ptr<std::string> const& buf() const {
             return buf_;
@@ -1769,38 +2476,94 @@ private:
             return buf_;
         }
 
-        std::tuple<char*, std::size_t> finalize(std::uint8_t fixed_header) {
-            auto rb = remaining_bytes(buf_->size() - payload_position_);
-            std::size_t start_position = payload_position_ - rb.size() - 1;
+        /**
+         * @brief Write the fixed header and the remaining length in front of the buffer.
+         * @param fixed_header fixed header
+         * @param payload_size size of the payload that is written following the buffer
+         * @return pointer to the top of the packet and the size of the bytes in the buffer
+         */
+        std::tuple<char*, std::size_t> finalize(std::uint8_t fixed_header, std::size_t payload_size = 0) {
+            std::size_t remaining_length = buf_->size() - payload_position_ + payload_size;
+            std::size_t start_position = payload_position_ - remaining_length_size(remaining_length) - 1;
             (*buf_)[start_position] = fixed_header;
-            buf_->replace(start_position + 1, rb.size(), rb);
+            encode_remaining_length(remaining_length, &(*buf_)[start_position + 1]);
             return std::make_tuple(
                 &(*buf_)[start_position],
                 buf_->size() - start_position);
         }
+        // Append 2 bytes big endian value such as the packet id.
+        void append_uint16(std::uint16_t value) {
+            char bytes[2];
+            encode_length(value, bytes);
+            buf_->append(bytes, sizeof(bytes));
+        }
+
+        // Append the length of the string and the string.
+        void append_string(std::string const& str) {
+            append_uint16(static_cast<std::uint16_t>(str.size()));
+            buf_->append(str);
+        }
+
+        // Append the bytes that are already encoded.
+        void append(string_view bytes) {
+            buf_->append(bytes.data(), bytes.size());
+        }
     private:
         static constexpr std::size_t const payload_position_ = 5;
         std::shared_ptr<std::string> buf_;
     };
 
+    // The packet consists of the bytes at ptr and the optional payload.
+    // The payload is written following the bytes without copying.
+    // The fixed size packets are held in the inline storage without heap allocation.
     class packet {
     public:
         packet(
             std::shared_ptr<std::string> const& b = nullptr,
             char* p = nullptr,
-            std::size_t s = 0)
+            std::size_t s = 0,
+            contents_buffer const& payload = contents_buffer())
             :
             buf_(b),
             ptr_(p),
-            size_(s) {}
+            size_(s),
+            payload_(payload),
+            fixed_() {}
+        // Fixed header and zero remaining length, e.g. PINGREQ.
+        explicit packet(std::uint8_t fixed_header)
+            :
+            ptr_(nullptr),
+            size_(2),
+            fixed_ {{ static_cast<char>(fixed_header), 0, 0, 0 }} {}
+        // Fixed header and two bytes variable header, e.g. PUBACK.
+        packet(std::uint8_t fixed_header, std::uint16_t variable_header)
+            :
+            ptr_(nullptr),
+            size_(4),
+            fixed_ {{
+                static_cast<char>(fixed_header),
+                2,
+                static_cast<char>(variable_header >> 8),
+                static_cast<char>(variable_header & 0xff)
+            }} {}
         std::shared_ptr<std::string> const& buf() const { return buf_; }
-        char const* ptr() const { return ptr_; }
-        char* ptr() { return ptr_; }
-        std::size_t size() const { return size_; }
+        char const* ptr() const { return ptr_ ? ptr_ : fixed_.data(); }
+        char* ptr() { return ptr_ ? ptr_ : fixed_.data(); }
+        std::size_t header_size() const { return size_; }
+        contents_buffer const& payload() const { return payload_; }
+        std::size_t size() const { return size_ + payload_.size(); }
+        std::array<as::const_buffer, 2> const_buffers() const {
+            return {{
+                as::buffer(ptr(), size_),
+                as::buffer(payload_.data(), payload_.size())
+            }};
+        }
     private:
         std::shared_ptr<std::string> buf_;
         char* ptr_;
         std::size_t size_;
+        contents_buffer payload_;
+        std::array<char, 4> fixed_;
     };
 
     struct store {
@@ -1809,182 +2572,140 @@ private:
             std::uint8_t type,
             std::shared_ptr<std::string> const& b = nullptr,
             char* p = nullptr,
-            std::size_t s = 0)
+            std::size_t s = 0,
+            contents_buffer const& payload = contents_buffer())
             :
             packet_id_(id),
             expected_control_packet_type_(type),
-            packet_(b, p, s) {}
+            packet_(b, p, s, payload) {}
+        store(
+            std::uint16_t id,
+            std::uint8_t type,
+            packet const& p)
+            :
+            packet_id_(id),
+            expected_control_packet_type_(type),
+            packet_(p) {}
         std::uint16_t packet_id() const { return packet_id_; }
         std::uint8_t expected_control_packet_type() const { return expected_control_packet_type_; }
         std::shared_ptr<std::string> const& buf() const { return packet_.buf(); }
         char const* ptr() const { return packet_.ptr(); }
         char* ptr() { return packet_.ptr(); }
+        std::size_t header_size() const { return packet_.header_size(); }
+        contents_buffer const& payload() const { return packet_.payload(); }
         std::size_t size() const { return packet_.size(); }
+        std::array<as::const_buffer, 2> const_buffers() const { return packet_.const_buffers(); }
+        packet const& stored_packet() const { return packet_; }
     private:
         std::uint16_t packet_id_;
         std::uint8_t expected_control_packet_type_;
         packet packet_;
     };
 
-    struct tag_packet_id {};
-    struct tag_packet_id_type {};
-    struct tag_seq {};
-    using mi_store = mi::multi_index_container<
-        store,
-        mi::indexed_by<
-            mi::ordered_unique<
-                mi::tag<tag_packet_id_type>,
-                mi::composite_key<
-                    store,
-                    mi::const_mem_fun<
-                        store, std::uint16_t,
-                        &store::packet_id
-                    >,
-                    mi::const_mem_fun<
-                        store, std::uint8_t,
-                        &store::expected_control_packet_type
-                    >
-                >
-            >,
-            mi::ordered_non_unique<
-                mi::tag<tag_packet_id>,
-                mi::const_mem_fun<
-                    store, std::uint16_t,
-                    &store::packet_id
-                >
-            >,
-            mi::sequenced<
-                mi::tag<tag_seq>
-            >
-        >
-    >;
-
-    void handle_control_packet_type(async_handler_t const& func) {
-        fixed_header_ = static_cast<std::uint8_t>(buf_);
-        remaining_length_ = 0;
-        remaining_length_multiplier_ = 1;
-        auto self = this->shared_from_this();
-        as::async_read(
-            *socket_,
-            as::buffer(&buf_, 1),
-            [this, self, func](
-                boost::system::error_code const& ec,
-                std::size_t bytes_transferred){
-                if (handle_close_or_error(ec)) {
-                    if (func) func(ec);
-                    return;
-                }
-                if (bytes_transferred != 1) {
-                    if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                    return;
-                }
-                handle_remaining_length(func);
-            }
-        );
-    }
+    // The publish that waits for the room of the in-flight window.
+    struct waiting_publish {
+        std::uint16_t packet_id;
+        std::uint8_t expected_control_packet_type;
+        packet p;
+        bool async;
+        async_handler_t func;
+    };
 
-    void handle_remaining_length(async_handler_t const& func) {
-        remaining_length_ += (buf_ & 0b01111111) * remaining_length_multiplier_;
-        remaining_length_multiplier_ *= 128;
-        if (remaining_length_multiplier_ > 128 * 128 * 128 * 128) throw remaining_length_error();
-        auto self = this->shared_from_this();
-        if (buf_ & 0b10000000) {
-            as::async_read(
-                *socket_,
-                as::buffer(&buf_, 1),
-                [this, self, func](
-                    boost::system::error_code const& ec,
-                    std::size_t bytes_transferred){
-                    if (handle_close_or_error(ec)) {
-                        if (func) func(ec);
-                        return;
-                    }
-                    if (bytes_transferred != 1) {
-                        if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                        return;
-                    }
-                    handle_remaining_length(func);
-                }
-            );
+    // Forwards the packets decoded by the parser to the endpoint.
+    struct packet_visitor {
+        bool on_connect(
+            std::string client_id,
+            boost::optional<std::string> user_name,
+            boost::optional<std::string> password,
+            boost::optional<will> w,
+            bool clean_session,
+            std::uint16_t keep_alive) {
+            return ep.handle_connect(client_id, user_name, password, std::move(w), clean_session, keep_alive);
         }
-        else {
-            payload_.resize(remaining_length_);
-            if (remaining_length_ == 0) {
-                handle_payload(func);
-                return;
-            }
-            as::async_read(
-                *socket_,
-                as::buffer(payload_),
-                [this, self, func](
-                    boost::system::error_code const& ec,
-                    std::size_t bytes_transferred){
-                    if (handle_close_or_error(ec)) {
-                        if (func) func(ec);
-                        return;
-                    }
-                    if (bytes_transferred != remaining_length_) {
-                        if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                        return;
-                    }
-                    handle_payload(func);
-                }
-            );
+        bool on_connack(bool session_present, std::uint8_t return_code) {
+            return ep.handle_connack(session_present, return_code);
+        }
+        bool on_publish(
+            std::uint8_t fixed_header,
+            boost::optional<std::uint16_t> packet_id,
+            string_view topic_name,
+            string_view contents) {
+            return ep.handle_publish(fixed_header, packet_id, topic_name, contents, func);
+        }
+        bool on_publish_begin(
+            std::uint8_t fixed_header,
+            boost::optional<std::uint16_t> packet_id,
+            string_view topic_name,
+            std::size_t contents_size) {
+            return ep.handle_publish_begin(fixed_header, packet_id, topic_name, contents_size);
+        }
+        bool on_publish_chunk(string_view chunk, bool last) {
+            return ep.handle_publish_chunk(chunk, last, func);
+        }
+        bool on_puback(std::uint16_t packet_id) {
+            return ep.handle_puback(packet_id);
+        }
+        bool on_pubrec(std::uint16_t packet_id) {
+            return ep.handle_pubrec(packet_id, func);
+        }
+        bool on_pubrel(std::uint16_t packet_id) {
+            return ep.handle_pubrel(packet_id, func);
+        }
+        bool on_pubcomp(std::uint16_t packet_id) {
+            return ep.handle_pubcomp(packet_id);
+        }
+        bool on_subscribe(std::uint16_t packet_id, std::vector<std::tuple<std::string, std::uint8_t>> entries) {
+            return ep.handle_subscribe(packet_id, std::move(entries));
+        }
+        bool on_suback(std::uint16_t packet_id, std::vector<boost::optional<std::uint8_t>> qoss) {
+            return ep.handle_suback(packet_id, std::move(qoss));
+        }
+        bool on_unsubscribe(std::uint16_t packet_id, std::vector<std::string> topics) {
+            return ep.handle_unsubscribe(packet_id, std::move(topics));
+        }
+        bool on_unsuback(std::uint16_t packet_id) {
+            return ep.handle_unsuback(packet_id);
+        }
+        bool on_pingreq() {
+            return ep.handle_pingreq();
+        }
+        bool on_pingresp() {
+            return ep.handle_pingresp();
+        }
+        bool on_disconnect() {
+            ep.handle_disconnect();
+            return false;
         }
-    }
 
-    void handle_payload(async_handler_t const& func) {
-        auto control_packet_type = get_control_packet_type(fixed_header_);
-        bool ret = false;
-        switch (control_packet_type) {
-        case control_packet_type::connect:
-            ret = handle_connect(func);
-            break;
-        case control_packet_type::connack:
-            ret = handle_connack(func);
-            break;
-        case control_packet_type::publish:
-            ret = handle_publish(func);
-            break;
-        case control_packet_type::puback:
-            ret = handle_puback(func);
-            break;
-        case control_packet_type::pubrec:
-            ret = handle_pubrec(func);
-            break;
-        case control_packet_type::pubrel:
-            ret = handle_pubrel(func);
-            break;
-        case control_packet_type::pubcomp:
-            ret = handle_pubcomp(func);
-            break;
-        case control_packet_type::subscribe:
-            ret = handle_subscribe(func);
-            break;
-        case control_packet_type::suback:
-            ret = handle_suback(func);
-            break;
-        case control_packet_type::unsubscribe:
-            ret = handle_unsubscribe(func);
-            break;
-        case control_packet_type::unsuback:
-            ret = handle_unsuback(func);
-            break;
-        case control_packet_type::pingreq:
-            ret = handle_pingreq(func);
-            break;
-        case control_packet_type::pingresp:
-            ret = handle_pingresp(func);
+        endpoint& ep;
+        async_handler_t const& func;
+    };
+
+    void handle_received_bytes(async_handler_t const& func) {
+        parser_.set_chunk_size(h_publish_begin_ && h_publish_chunk_ ? read_buffer_size_ : 0);
+        packet_visitor v { *this, func };
+        auto r = parser_.parse(read_buf_->data() + read_begin_, read_end_ - read_begin_, v);
+        read_begin_ += r.consumed;
+        switch (r.st) {
+        case packet_parser::status::need_more:
+            read_required_ = parser_.required();
+            if (read_required_ > read_buf_->size() &&
+                read_required_ + queued_bytes_ + stored_bytes_ > memory_budget_) {
+                auto ec = boost::system::errc::make_error_code(boost::system::errc::no_buffer_space);
+                handle_close_or_error(ec);
+                if (func) func(ec);
+                return;
+            }
+            async_read_packets(func);
             break;
-        case control_packet_type::disconnect:
-            handle_disconnect(func);
-            ret = false;
+        case packet_parser::status::stopped:
+            if (func) func(boost::system::errc::make_error_code(boost::system::errc::success));
             break;
-        default:
+        case packet_parser::status::error:
+            handle_close_or_error(r.ec);
+            if (func) func(r.ec);
             break;
         }
-        if (ret) async_read_control_packet_type(func);
-        else if (func) func(boost::system::errc::make_error_code(boost::system::errc::success));
     }
 
     void handle_close() {
@@ -1995,90 +2716,13 @@ private:
         if (h_error_) h_error_(ec);
     }
 
-    bool handle_connect(async_handler_t const& func) {
-        std::size_t i = 0;
-        if (remaining_length_ < 10 ||
-            payload_[i++] != 0x00 ||
-            payload_[i++] != 0x04 ||
-            payload_[i++] != 'M' ||
-            payload_[i++] != 'Q' ||
-            payload_[i++] != 'T' ||
-            payload_[i++] != 'T' ||
-            payload_[i++] != 0x04) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
-            return false;
-        }
-        char byte8 = payload_[i++];
-
-        std::uint16_t keep_alive;
-        keep_alive = make_uint16_t(payload_[i], payload_[i + 1]);
-        i += 2;
-
-        if (remaining_length_ < i + 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-
-        std::uint16_t client_id_length;
-        client_id_length = make_uint16_t(payload_[i], payload_[i + 1]);
-        i += 2;
-        if (remaining_length_ < i + client_id_length) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::string client_id(payload_.data() + i, client_id_length);
-        i += client_id_length;
-
-        bool clean_session = connect_flags::has_clean_session(byte8);
-        boost::optional<will> w;
-        if (connect_flags::has_will_flag(byte8)) {
-            std::uint16_t topic_name_length;
-            topic_name_length = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            if (remaining_length_ < i + topic_name_length) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            std::string topic_name(payload_.data() + i, topic_name_length);
-            i += topic_name_length;
-            std::uint16_t will_message_length;
-            will_message_length = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            if (remaining_length_ < i + will_message_length) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            std::string will_message(payload_.data() + i, topic_name_length);
-            i += will_message_length;
-            w = will(topic_name,
-                        will_message,
-                        connect_flags::has_will_retain(byte8),
-                        connect_flags::will_qos(byte8));
-        }
-        boost::optional<std::string> user_name;
-        if (connect_flags::has_user_name_flag(byte8)) {
-            std::uint16_t user_name_length;
-            user_name_length = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            if (remaining_length_ < i + user_name_length) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            user_name = std::string(payload_.data() + i, user_name_length);
-            i += user_name_length;
-        }
-        boost::optional<std::string> password;
-        if (connect_flags::has_password_flag(byte8)) {
-            std::uint16_t password_length;
-            password_length = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            if (remaining_length_ < i + password_length) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            password = std::string(payload_.data() + i, password_length);
-            i += password_length;
-        }
+    bool handle_connect(
+        std::string const& client_id,
+        boost::optional<std::string> const& user_name,
+        boost::optional<std::string> const& password,
+        boost::optional<will> w,
+        bool clean_session,
+        std::uint16_t keep_alive) {
         if (h_connect_) {
             if (h_connect_(client_id, user_name, password, std::move(w), clean_session, keep_alive)) {
                 return true;
@@ -2088,46 +2732,43 @@ private:
         return true;
     }
 
-    bool handle_connack(async_handler_t const& func) {
-        if (remaining_length_ != 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        if (static_cast<std::uint8_t>(payload_[1]) == connect_return_code::accepted) {
+    bool handle_connack(bool session_present, std::uint8_t return_code) {
+        if (return_code == connect_return_code::accepted) {
             if (clean_session_) {
                 LockGuard<Mutex> lck (store_mtx_);
+                // The blocking publishes waiting for the in-flight window are still counted.
+                for (auto const& e : store_) stored_bytes_ -= e.size();
                 store_.clear();
+                inflight_.clear();
+                if (session_store_) session_store_->clear();
+                resend_.clear();
+                resending_ = true;
             }
             else {
                 LockGuard<Mutex> lck (store_mtx_);
-                auto& idx = store_.template get<tag_seq>();
-                auto it = idx.begin();
-                auto end = idx.end();
+                resend_.clear();
+                auto it = store_.begin();
+                auto end = store_.end();
                 while (it != end) {
-                    if (it->buf()) {
-                        idx.modify(
-                            it,
-                            [this](store& e){
-                                if (e.expected_control_packet_type() == control_packet_type::puback ||
-                                    e.expected_control_packet_type() == control_packet_type::pubrec) {
-                                    *e.ptr() |= 0b00001000; // set DUP flag
-                                }
-                                // I choose sync write intentionaly.
-                                // If calling async_write, and then disconnected,
-                                // strand object would be dangling references.
-                                this->write(e.ptr(), e.size());
-                            }
-                        );
+                    if (it->size() != 0) {
+                        if (it->expected_control_packet_type() == control_packet_type::puback ||
+                            it->expected_control_packet_type() == control_packet_type::pubrec) {
+                            *it->ptr() |= 0b00001000; // set DUP flag
+                        }
+                        resend_.push_back(*it);
                         ++it;
                     }
                     else {
-                        it = idx.erase(it);
+                        inflight_.release(it->packet_id());
+                        if (session_store_) session_store_->remove(it->packet_id());
+                        it = store_.erase(it);
                     }
                 }
+                resending_ = true;
             }
+            resend_stored();
         }
-        bool session_present = is_session_present(payload_[0]);
-        if (h_connack_) return h_connack_(session_present, static_cast<std::uint8_t>(payload_[1]));
+        if (h_connack_) return h_connack_(session_present, return_code);
         return true;
     }
 
@@ -2139,86 +2780,68 @@ private:
         }
     }
 
-    bool handle_publish(async_handler_t const& func) {
-        if (remaining_length_ < 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::size_t i = 0;
-        std::uint16_t topic_name_length = make_uint16_t(payload_[i], payload_[i + 1]);
-        i += 2;
-        if (remaining_length_ < i + topic_name_length) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
+    void publish_response(std::uint8_t qos, std::uint16_t packet_id, async_handler_t const& func) {
+        switch (qos) {
+        case qos::at_least_once:
+            auto_pub_response(
+                [this, packet_id] {
+                    if (connected_) send_puback(packet_id);
+                },
+                [this, packet_id, &func] {
+                    if (connected_) async_send_puback(packet_id, func);
+                }
+            );
+            break;
+        case qos::exactly_once:
+            auto_pub_response(
+                [this, packet_id] {
+                    if (connected_) send_pubrec(packet_id);
+                },
+                [this, packet_id, &func] {
+                    if (connected_) async_send_pubrec(packet_id, func);
+                }
+            );
+            break;
+        default:
+            break;
         }
-        std::string topic_name(payload_.data() + i, topic_name_length);
-        i += topic_name_length;
-        boost::optional<std::uint16_t> packet_id;
-        auto qos = publish::get_qos(fixed_header_);
+    }
+
+    bool handle_publish(
+        std::uint8_t fixed_header,
+        boost::optional<std::uint16_t> packet_id,
+        string_view topic_name,
+        string_view contents,
+        async_handler_t const& func) {
+        auto qos = publish::get_qos(fixed_header);
         switch (qos) {
         case qos::at_most_once:
-            if (h_publish_) {
-                std::string contents(payload_.data() + i, payload_.size() - i);
-                return h_publish_(fixed_header_, packet_id, std::move(topic_name), std::move(contents));
+            if (has_publish_handler()) {
+                return call_publish_handler(fixed_header, packet_id, topic_name, contents);
             }
             break;
-        case qos::at_least_once: {
-            if (remaining_length_ < i + 2) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            packet_id = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            auto res = [this, &packet_id, &func] {
-                auto_pub_response(
-                    [this, &packet_id] {
-                        if (connected_) send_puback(*packet_id);
-                    },
-                    [this, &packet_id, &func] {
-                        if (connected_) async_send_puback(*packet_id, func);
-                    }
-                );
-            };
-            if (h_publish_) {
-                std::string contents(payload_.data() + i, payload_.size() - i);
-                if (h_publish_(fixed_header_, packet_id, std::move(topic_name), std::move(contents))) {
-                    res();
+        case qos::at_least_once:
+            if (has_publish_handler()) {
+                if (call_publish_handler(fixed_header, packet_id, topic_name, contents)) {
+                    publish_response(qos, *packet_id, func);
                     return true;
                 }
                 return false;
             }
-            res();
-        } break;
+            publish_response(qos, *packet_id, func);
+            break;
         case qos::exactly_once: {
-            if (remaining_length_ < i + 2) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            packet_id = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            auto res = [this, &packet_id, &func] {
-                auto_pub_response(
-                    [this, &packet_id] {
-                        if (connected_) send_pubrec(*packet_id);
-                    },
-                    [this, &packet_id, &func] {
-                        if (connected_) async_send_pubrec(*packet_id, func);
-                    }
-                );
-            };
             auto it = qos2_publish_handled_.find(*packet_id);
             if (it == qos2_publish_handled_.end()) {
-                std::string contents(payload_.data() + i, payload_.size() - i);
-                if (h_publish_) {
-                    std::string contents(payload_.data() + i, payload_.size() - i);
-                    if (h_publish_(fixed_header_, packet_id, std::move(topic_name), std::move(contents))) {
-                        res();
+                if (has_publish_handler()) {
+                    if (call_publish_handler(fixed_header, packet_id, topic_name, contents)) {
+                        publish_response(qos, *packet_id, func);
                         return true;
                     }
                     return false;
                 }
             }
-            res();
+            publish_response(qos, *packet_id, func);
         } break;
         default:
             break;
@@ -2226,34 +2849,67 @@ private:
         return true;
     }
 
-    bool handle_puback(async_handler_t const& func) {
-        if (remaining_length_ != 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
+    bool handle_publish_begin(
+        std::uint8_t fixed_header,
+        boost::optional<std::uint16_t> packet_id,
+        string_view topic_name,
+        std::size_t contents_size) {
+        auto qos = publish::get_qos(fixed_header);
+        chunk_qos_ = qos;
+        chunk_packet_id_ = packet_id;
+        chunk_deliver_ =
+            qos != qos::exactly_once ||
+            qos2_publish_handled_.find(*packet_id) == qos2_publish_handled_.end();
+        if (chunk_deliver_) {
+            return h_publish_begin_(fixed_header, packet_id, topic_name, contents_size);
+        }
+        return true;
+    }
+
+    bool handle_publish_chunk(string_view chunk, bool last, async_handler_t const& func) {
+        if (chunk_deliver_ && !h_publish_chunk_(chunk, last)) return false;
+        if (last && chunk_packet_id_) {
+            publish_response(chunk_qos_, *chunk_packet_id_, func);
+        }
+        return true;
+    }
+
+    bool has_publish_handler() const {
+        return h_publish_buffer_ || h_publish_view_ || h_publish_;
+    }
+
+    bool call_publish_handler(
+        std::uint8_t fixed_header,
+        boost::optional<std::uint16_t> packet_id,
+        string_view topic_name,
+        string_view contents) {
+        if (h_publish_buffer_) {
+            return h_publish_buffer_(
+                fixed_header,
+                packet_id,
+                shared_buffer(read_buf_, topic_name.data(), topic_name.size()),
+                shared_buffer(read_buf_, contents.data(), contents.size()));
         }
-        std::uint16_t packet_id = make_uint16_t(payload_[0], payload_[1]);
+        if (h_publish_view_) return h_publish_view_(fixed_header, packet_id, topic_name, contents);
+        return h_publish_(fixed_header, packet_id, topic_name.to_string(), contents.to_string());
+    }
+
+    bool handle_puback(std::uint16_t packet_id) {
         {
             LockGuard<Mutex> lck (store_mtx_);
-            auto& idx = store_.template get<tag_packet_id_type>();
-            auto r = idx.equal_range(std::make_tuple(packet_id, control_packet_type::puback));
-            idx.erase(std::get<0>(r), std::get<1>(r));
-            packet_id_.erase(packet_id);
+            erase_stored(packet_id, control_packet_type::puback);
+            release_packet_id(packet_id);
+            inflight_.release(packet_id);
         }
+        send_waiting_publishes();
         if (h_puback_) return h_puback_(packet_id);
         return true;
     }
 
-    bool handle_pubrec(async_handler_t const& func) {
-        if (remaining_length_ != 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::uint16_t packet_id = make_uint16_t(payload_[0], payload_[1]);
+    bool handle_pubrec(std::uint16_t packet_id, async_handler_t const& func) {
         {
             LockGuard<Mutex> lck (store_mtx_);
-            auto& idx = store_.template get<tag_packet_id_type>();
-            auto r = idx.equal_range(std::make_tuple(packet_id, control_packet_type::pubrec));
-            idx.erase(std::get<0>(r), std::get<1>(r));
+            erase_stored(packet_id, control_packet_type::pubrec);
             // packet_id shouldn't be erased here.
             // It is reused for pubrel/pubcomp.
         }
@@ -2280,12 +2936,7 @@ private:
         return true;
     }
 
-    bool handle_pubrel(async_handler_t const& func) {
-        if (remaining_length_ != 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::uint16_t packet_id = make_uint16_t(payload_[0], payload_[1]);
+    bool handle_pubrel(std::uint16_t packet_id, async_handler_t const& func) {
         auto res = [this, &packet_id, &func] {
             auto_pub_response(
                 [this, &packet_id] {
@@ -2308,153 +2959,58 @@ private:
         return true;
     }
 
-    bool handle_pubcomp(async_handler_t const& func) {
-        if (remaining_length_ != 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::uint16_t packet_id = make_uint16_t(payload_[0], payload_[1]);
+    bool handle_pubcomp(std::uint16_t packet_id) {
         {
             LockGuard<Mutex> lck (store_mtx_);
-            auto& idx = store_.template get<tag_packet_id_type>();
-            auto r = idx.equal_range(std::make_tuple(packet_id, control_packet_type::pubcomp));
-            idx.erase(std::get<0>(r), std::get<1>(r));
-            packet_id_.erase(packet_id);
+            erase_stored(packet_id, control_packet_type::pubcomp);
+            release_packet_id(packet_id);
+            inflight_.release(packet_id);
         }
+        send_waiting_publishes();
         if (h_pubcomp_) return h_pubcomp_(packet_id);
         return true;
     }
 
-    bool handle_subscribe(async_handler_t const& func) {
-        std::size_t i = 0;
-        if (remaining_length_ < 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::uint16_t packet_id = make_uint16_t(payload_[i], payload_[i + 1]);
-        i += 2;
-        std::vector<std::tuple<std::string, std::uint8_t>> entries;
-        while (i < remaining_length_) {
-            if (remaining_length_ < i + 2) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            std::uint16_t topic_length = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            if (remaining_length_ < i + topic_length) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            std::string topic_filter(payload_.data() + i, topic_length);
-            i += topic_length;
-
-            std::uint8_t qos = payload_[i] & 0b00000011;
-            ++i;
-            entries.emplace_back(std::move(topic_filter), qos);
-        }
+    bool handle_subscribe(std::uint16_t packet_id, std::vector<std::tuple<std::string, std::uint8_t>> entries) {
         if (h_subscribe_) return h_subscribe_(packet_id, std::move(entries));
         return true;
     }
 
-    bool handle_suback(async_handler_t const& func) {
-        if (remaining_length_ < 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::uint16_t packet_id = make_uint16_t(payload_[0], payload_[1]);
-        {
-            LockGuard<Mutex> lck (store_mtx_);
-            packet_id_.erase(packet_id);
-        }
-        std::vector<boost::optional<std::uint8_t>> results;
-        results.reserve(payload_.size() - 2);
-        auto it = payload_.cbegin() + 2;
-        auto end = payload_.cend();
-        for (; it != end; ++it) {
-            if (*it & 0b10000000) {
-                results.push_back(boost::none);
-            }
-            else {
-                results.push_back(*it);
-            }
-        }
+    bool handle_suback(std::uint16_t packet_id, std::vector<boost::optional<std::uint8_t>> results) {
+        release_packet_id(packet_id);
         if (h_suback_) return h_suback_(packet_id, std::move(results));
         return true;
     }
 
-    bool handle_unsubscribe(async_handler_t const& func) {
-        std::size_t i = 0;
-        if (remaining_length_ < 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::uint16_t packet_id = make_uint16_t(payload_[i], payload_[i + 1]);
-        i += 2;
-        std::vector<std::string> topic_filters;
-        while (i < remaining_length_) {
-            if (remaining_length_ < i + 2) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            std::uint16_t topic_length = make_uint16_t(payload_[i], payload_[i + 1]);
-            i += 2;
-            if (remaining_length_ < i + topic_length) {
-                if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-                return false;
-            }
-            std::string topic_filter(payload_.data() + i, topic_length);
-            i += topic_length;
-
-            topic_filters.emplace_back(std::move(topic_filter));
-        }
+    bool handle_unsubscribe(std::uint16_t packet_id, std::vector<std::string> topic_filters) {
         if (h_unsubscribe_) return h_unsubscribe_(packet_id, std::move(topic_filters));
         return true;
     }
 
-    bool handle_unsuback(async_handler_t const& func) {
-        if (remaining_length_ != 2) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
-        std::uint16_t packet_id = make_uint16_t(payload_[0], payload_[1]);
-        {
-            LockGuard<Mutex> lck (store_mtx_);
-            packet_id_.erase(packet_id);
-        }
+    bool handle_unsuback(std::uint16_t packet_id) {
+        release_packet_id(packet_id);
         if (h_unsuback_) return h_unsuback_(packet_id);
         return true;
     }
 
-    bool handle_pingreq(async_handler_t const& func) {
-        if (remaining_length_ != 0) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
+    bool handle_pingreq() {
         if (h_pingreq_) return h_pingreq_();
         return true;
     }
 
-    bool handle_pingresp(async_handler_t const& func) {
-        if (remaining_length_ != 0) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return false;
-        }
+    bool handle_pingresp() {
         if (h_pingresp_) return h_pingresp_();
         return true;
     }
 
-    void handle_disconnect(async_handler_t const& func) {
-        if (remaining_length_ != 0) {
-            if (func) func(boost::system::errc::make_error_code(boost::system::errc::message_size));
-            return;
-        }
+    void handle_disconnect() {
         if (h_disconnect_) h_disconnect_();
     }
 
     // Blocking senders.
     void send_connect(std::uint16_t keep_alive_sec) {
 
-        send_buffer sb;
+        send_buffer sb(send_buffer_pool_);
         std::size_t payload_position = 5; // Fixed Header + max size of Remaining bytes
         sb.buf()->resize(payload_position);
         sb.buf()->push_back(0x00);   // Length MSB(0)
@@ -2474,9 +3030,8 @@ private:
 
         // endpoint id
         if (!utf8string::is_valid_length(client_id_)) throw utf8string_length_error();
-        if (!utf8string::is_valid_contents(client_id_)) throw utf8string_contents_error();
-        sb.buf()->insert(sb.buf()->size(), encoded_length(client_id_));
-        sb.buf()->insert(sb.buf()->size(), client_id_);
+        if (utf8_check_send_ && !utf8string::is_valid_contents(client_id_)) throw utf8string_contents_error();
+        sb.append_string(client_id_);
 
         // will
         if (will_) {
@@ -2486,13 +3041,11 @@ private:
             connect_flags::set_will_qos(c, will_->qos());
 
             if (!utf8string::is_valid_length(will_->topic())) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(will_->topic())) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(will_->topic()));
-            sb.buf()->insert(sb.buf()->size(), will_->topic());
+            if (utf8_check_send_ && !utf8string::is_valid_contents(will_->topic())) throw utf8string_contents_error();
+            sb.append_string(will_->topic());
 
             if (will_->message().size() > 0xffff) throw will_message_length_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(will_->message()));
-            sb.buf()->insert(sb.buf()->size(), will_->message());
+            sb.append_string(will_->message());
         }
 
         // user_name, password
@@ -2501,17 +3054,15 @@ private:
             c |= connect_flags::user_name_flag;
             std::string const& str = *user_name_;
             if (!utf8string::is_valid_length(str)) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(str)) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(str));
-            sb.buf()->insert(sb.buf()->size(), str);
+            if (utf8_check_send_ && !utf8string::is_valid_contents(str)) throw utf8string_contents_error();
+            sb.append_string(str);
         }
         if (password_) {
             char& c = (*sb.buf())[connect_flags_position];
             c |= connect_flags::password_flag;
             std::string const& str = *password_;
             if (str.size() > 0xffff) throw password_length_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(str));
-            sb.buf()->insert(sb.buf()->size(), str);
+            sb.append_string(str);
         }
 
         auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::connect, 0));
@@ -2519,104 +3070,107 @@ private:
     }
 
     void send_connack(bool session_present, std::uint8_t return_code) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(session_present ? 1 : 0));
-        sb.buf()->push_back(static_cast<char>(return_code));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::connack, 0b0000));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(
+            make_fixed_header(control_packet_type::connack, 0b0000),
+            static_cast<std::uint16_t>((session_present ? 1 : 0) << 8 | return_code));
+        write(p.const_buffers());
     }
 
     void send_publish(
-        std::string const& topic_name,
+        topic_view topic_name,
         std::uint16_t qos,
         bool retain,
         bool dup,
         std::uint16_t packet_id,
-        std::string const& payload) {
+        contents_buffer const& payload) {
 
-        send_buffer sb;
-        if (!utf8string::is_valid_length(topic_name)) throw utf8string_length_error();
-        if (!utf8string::is_valid_contents(topic_name)) throw utf8string_contents_error();
-        sb.buf()->insert(sb.buf()->size(), encoded_length(topic_name));
-        sb.buf()->insert(sb.buf()->size(), topic_name);
+        send_buffer sb(send_buffer_pool_, 2 + topic_name.name().size() + 2);
+        append_topic_name(sb, topic_name);
         if (qos == qos::at_least_once ||
             qos == qos::exactly_once) {
-            sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-            sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+            sb.append_uint16(packet_id);
         }
-        sb.buf()->insert(sb.buf()->size(), payload);
         std::uint8_t flags = 0;
         if (retain) flags |= 0b00000001;
         if (dup) flags |= 0b00001000;
         flags |= qos << 1;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::publish, flags));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        // The payload is written following the header without copying.
+        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::publish, flags), payload.size());
         if (qos > 0) {
-            flags |= 0b00001000;
-            ptr_size = sb.finalize(make_fixed_header(control_packet_type::publish, flags));
             LockGuard<Mutex> lck (store_mtx_);
-            store_.emplace(
+            if (!enter_inflight(packet_id, dup)) {
+                inflight_waiting_.push_back(
+                    waiting_publish {
+                        packet_id,
+                        qos == qos::at_least_once ? control_packet_type::puback
+                                                  : control_packet_type::pubrec,
+                        packet(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), share_payload(payload)),
+                        false,
+                        async_handler_t()
+                    }
+                );
+                // Counted as a stored packet until it is sent.
+                stored_bytes_ += inflight_waiting_.back().p.size();
+                return;
+            }
+            store_publish(
                 packet_id,
                 qos == qos::at_least_once ? control_packet_type::puback
                                           : control_packet_type::pubrec,
                 sb.buf(),
                 std::get<0>(ptr_size),
-                std::get<1>(ptr_size));
+                std::get<1>(ptr_size),
+                share_payload(payload));
+        }
+        write(
+            std::array<as::const_buffer, 2> {{
+                as::buffer(std::get<0>(ptr_size), std::get<1>(ptr_size)),
+                as::buffer(payload.data(), payload.size())
+            }}
+        );
+        if (qos > 0) {
+            // The stored packet shares the buffer.
+            flags |= 0b00001000;
+            LockGuard<Mutex> lck (store_mtx_);
+            sb.finalize(make_fixed_header(control_packet_type::publish, flags), payload.size());
         }
     }
 
     void send_puback(std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::puback, 0b0000));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::puback, 0b0000), packet_id);
+        write(p.const_buffers());
         if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
     }
 
     void send_pubrec(std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pubrec, 0b0000));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::pubrec, 0b0000), packet_id);
+        write(p.const_buffers());
     }
 
     void send_pubrel(std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pubrel, 0b0010));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
-        LockGuard<Mutex> lck (store_mtx_);
-        store_.emplace(
-            packet_id,
-            control_packet_type::pubcomp,
-            sb.buf(),
-            std::get<0>(ptr_size),
-            std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::pubrel, 0b0010), packet_id);
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            emplace_stored(
+                packet_id,
+                control_packet_type::pubcomp,
+                p);
+        }
+        write(p.const_buffers());
     }
 
     void store_pubrel(std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pubrel, 0b0010));
+        packet p(make_fixed_header(control_packet_type::pubrel, 0b0010), packet_id);
         LockGuard<Mutex> lck (store_mtx_);
-        store_.emplace(
+        emplace_stored(
             packet_id,
             control_packet_type::pubcomp,
-            sb.buf(),
-            std::get<0>(ptr_size),
-            std::get<1>(ptr_size));
+            p);
     }
 
     void send_pubcomp(std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pubcomp, 0b0000));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::pubcomp, 0b0000), packet_id);
+        write(p.const_buffers());
         if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
     }
 
@@ -2633,14 +3187,12 @@ private:
     void send_subscribe(
         std::vector<std::tuple<std::reference_wrapper<std::string const>, std::uint8_t>>& params,
         std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+        send_buffer sb(send_buffer_pool_);
+        sb.append_uint16(packet_id);
         for (auto const& e : params) {
             if (!utf8string::is_valid_length(std::get<0>(e))) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(std::get<0>(e))) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(std::get<0>(e)));
-            sb.buf()->insert(sb.buf()->size(), std::get<0>(e));
+            if (utf8_check_send_ && !utf8string::is_valid_contents(std::get<0>(e))) throw utf8string_contents_error();
+            sb.append_string(std::get<0>(e));
             sb.buf()->push_back(std::get<1>(e));
         }
         auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::subscribe, 0b0010));
@@ -2659,9 +3211,8 @@ private:
     void send_suback(
         std::vector<std::uint8_t> const& params,
         std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+        send_buffer sb(send_buffer_pool_);
+        sb.append_uint16(packet_id);
         for (auto const& e : params) {
             sb.buf()->push_back(e);
         }
@@ -2682,14 +3233,12 @@ private:
     void send_unsubscribe(
         std::vector<std::reference_wrapper<std::string const>>& params,
         std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+        send_buffer sb(send_buffer_pool_);
+        sb.append_uint16(packet_id);
         for (auto const& e : params) {
             if (!utf8string::is_valid_length(e)) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(e)) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(e));
-            sb.buf()->insert(sb.buf()->size(), e);
+            if (utf8_check_send_ && !utf8string::is_valid_contents(e)) throw utf8string_contents_error();
+            sb.append_string(e);
         }
         auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::unsubscribe, 0b0010));
         write(std::get<0>(ptr_size), std::get<1>(ptr_size));
@@ -2697,42 +3246,64 @@ private:
 
     void send_unsuback(
         std::uint16_t packet_id) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::unsuback, 0b0010));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::unsuback, 0b0010), packet_id);
+        write(p.const_buffers());
     }
 
     void send_pingreq() {
-        send_buffer sb;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pingreq, 0b0000));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::pingreq, 0b0000));
+        write(p.const_buffers());
     }
 
     void send_pingresp() {
-        send_buffer sb;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pingresp, 0b0000));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::pingresp, 0b0000));
+        write(p.const_buffers());
     }
     void send_disconnect() {
-        send_buffer sb;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::disconnect, 0b0000));
-        write(std::get<0>(ptr_size), std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::disconnect, 0b0000));
+        write(p.const_buffers());
     }
 
     // Blocking write
     void write(char* ptr, std::size_t size) {
+        write(as::buffer(ptr, size));
+    }
+
+    template <typename ConstBufferSequence>
+    void write(ConstBufferSequence const& buffers) {
         boost::system::error_code ec;
-        as::write(*socket_, as::buffer(ptr, size), ec);
+        if (!append_batch(buffers, ec)) as::write(*socket_, buffers, ec);
         if (ec) handle_error(ec);
     }
 
+    // Append the buffers to the batch buffer if the batch is open.
+    // If the batch buffer would exceed the limit, it is written before appending.
+    template <typename ConstBufferSequence>
+    bool append_batch(ConstBufferSequence const& buffers, boost::system::error_code& ec) {
+        LockGuard<Mutex> lck (batch_mtx_);
+        if (!batching_) return false;
+        auto size = as::buffer_size(buffers);
+        if (!batch_buf_.empty() && batch_buf_.size() + size > max_coalesced_bytes_) {
+            write_batch(ec);
+        }
+        auto pos = batch_buf_.size();
+        batch_buf_.resize(pos + size);
+        as::buffer_copy(as::buffer(batch_buf_.data() + pos, size), buffers);
+        return true;
+    }
+
+    // batch_mtx_ should be locked
+    void write_batch(boost::system::error_code& ec) {
+        if (batch_buf_.empty()) return;
+        as::write(*socket_, as::buffer(batch_buf_), ec);
+        batch_buf_.clear();
+    }
+
     // Non blocking (async) senders
     template <typename F>
     void async_send_connect(std::uint16_t keep_alive_sec, F const& func) {
 
-        send_buffer sb;
+        send_buffer sb(send_buffer_pool_);
         std::size_t payload_position = 5; // Fixed Header + max size of Remaining bytes
         sb.buf()->resize(payload_position);
         sb.buf()->push_back(0x00);   // Length MSB(0)
@@ -2752,9 +3323,8 @@ private:
 
         // endpoint id
         if (!utf8string::is_valid_length(client_id_)) throw utf8string_length_error();
-        if (!utf8string::is_valid_contents(client_id_)) throw utf8string_contents_error();
-        sb.buf()->insert(sb.buf()->size(), encoded_length(client_id_));
-        sb.buf()->insert(sb.buf()->size(), client_id_);
+        if (utf8_check_send_ && !utf8string::is_valid_contents(client_id_)) throw utf8string_contents_error();
+        sb.append_string(client_id_);
 
         // will
         if (will_) {
@@ -2764,13 +3334,11 @@ private:
             connect_flags::set_will_qos(c, will_->qos());
 
             if (!utf8string::is_valid_length(will_->topic())) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(will_->topic())) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(will_->topic()));
-            sb.buf()->insert(sb.buf()->size(), will_->topic());
+            if (utf8_check_send_ && !utf8string::is_valid_contents(will_->topic())) throw utf8string_contents_error();
+            sb.append_string(will_->topic());
 
             if (will_->message().size() > 0xffff) throw will_message_length_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(will_->message()));
-            sb.buf()->insert(sb.buf()->size(), will_->message());
+            sb.append_string(will_->message());
         }
 
         // user_name, password
@@ -2779,17 +3347,15 @@ private:
             c |= connect_flags::user_name_flag;
             std::string const& str = *user_name_;
             if (!utf8string::is_valid_length(str)) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(str)) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(str));
-            sb.buf()->insert(sb.buf()->size(), str);
+            if (utf8_check_send_ && !utf8string::is_valid_contents(str)) throw utf8string_contents_error();
+            sb.append_string(str);
         }
         if (password_) {
             char& c = (*sb.buf())[connect_flags_position];
             c |= connect_flags::password_flag;
             std::string const& str = *password_;
             if (str.size() > 0xffff) throw password_length_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(str));
-            sb.buf()->insert(sb.buf()->size(), str);
+            sb.append_string(str);
         }
 
         auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::connect, 0));
@@ -2798,61 +3364,102 @@ private:
 
     template <typename F>
     void async_send_connack(bool session_present, std::uint8_t return_code, F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(session_present ? 1 : 0));
-        sb.buf()->push_back(static_cast<char>(return_code));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::connack, 0b0000));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
+        packet p(
+            make_fixed_header(control_packet_type::connack, 0b0000),
+            static_cast<std::uint16_t>((session_present ? 1 : 0) << 8 | return_code));
+        async_write(p, func);
     }
 
     template <typename F>
     void async_send_publish(
-        std::string const& topic_name,
+        topic_view topic_name,
         std::uint16_t qos,
         bool retain,
         bool dup,
         std::uint16_t packet_id,
-        std::string const& payload,
+        contents_buffer const& payload,
         F const& func) {
+        if (!admit_publish(packet_id, func)) return;
+        async_queue_publish(topic_name, qos, retain, dup, packet_id, payload, func);
+    }
 
-        send_buffer sb;
-        if (!utf8string::is_valid_length(topic_name)) throw utf8string_length_error();
-        if (!utf8string::is_valid_contents(topic_name)) throw utf8string_contents_error();
-        sb.buf()->insert(sb.buf()->size(), encoded_length(topic_name));
-        sb.buf()->insert(sb.buf()->size(), topic_name);
+    template <typename F>
+    void async_queue_publish(
+        topic_view topic_name,
+        std::uint16_t qos,
+        bool retain,
+        bool dup,
+        std::uint16_t packet_id,
+        contents_buffer const& payload,
+        F const& func) {
+
+        send_buffer sb(send_buffer_pool_, 2 + topic_name.name().size() + 2);
+        append_topic_name(sb, topic_name);
         if (qos == qos::at_least_once ||
             qos == qos::exactly_once) {
-            sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-            sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+            sb.append_uint16(packet_id);
         }
-        sb.buf()->insert(sb.buf()->size(), payload);
         std::uint8_t flags = 0;
         if (retain) flags |= 0b00000001;
         if (dup) flags |= 0b00001000;
         flags |= qos << 1;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::publish, flags));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
+        // The payload is held apart from the header, and shared by the send queue and the store.
+        // It is copied once if the caller doesn't pass the ownership.
+        auto sp = share_payload(payload);
+        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::publish, flags), sp.size());
+        packet p(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), sp);
         if (qos > 0) {
+            bool rejected = false;
+            {
+                LockGuard<Mutex> lck (store_mtx_);
+                if (!enter_inflight(packet_id, dup)) {
+                    // The waiting publish is counted in the async send queue until it is sent,
+                    // so it is limited by the watermarks and the memory budget.
+                    if (memory_usage() + p.size() > memory_budget_) {
+                        rejected = true;
+                    }
+                    else {
+                        inflight_waiting_.push_back(
+                            waiting_publish {
+                                packet_id,
+                                qos == qos::at_least_once ? control_packet_type::puback
+                                                          : control_packet_type::pubrec,
+                                p,
+                                true,
+                                func
+                            }
+                        );
+                        queued_bytes_ += p.size();
+                        ++queued_count_;
+                        return;
+                    }
+                }
+            }
+            if (rejected) {
+                reject_publish(packet_id, func);
+                return;
+            }
             LockGuard<Mutex> lck (store_mtx_);
-            store_.emplace(
+            store_publish(
                 packet_id,
                 qos == qos::at_least_once ? control_packet_type::puback
                                           : control_packet_type::pubrec,
-                sb.buf(),
-                std::get<0>(ptr_size),
-                std::get<1>(ptr_size));
+                p);
         }
+        async_write(p, func);
     }
 
     template <typename F>
     void async_send_puback(std::uint16_t packet_id, F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::puback, 0b0000));
+        packet p(make_fixed_header(control_packet_type::puback, 0b0000), packet_id);
+        if (!h_pub_res_sent_) {
+            // No need to wrap the handler.
+            async_write(p, func);
+            return;
+        }
         auto self = this->shared_from_this();
         async_write(
-            sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size),
+            p,
             [this, self, packet_id, func](boost::system::error_code const& ec){
                 if (func) func(ec);
                 if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
@@ -2861,38 +3468,34 @@ private:
 
     template <typename F>
     void async_send_pubrec(std::uint16_t packet_id, F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pubrec, 0b0000));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
+        packet p(make_fixed_header(control_packet_type::pubrec, 0b0000), packet_id);
+        async_write(p, func);
     }
 
     template <typename F>
     void async_send_pubrel(std::uint16_t packet_id, F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pubrel, 0b0010));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
-        LockGuard<Mutex> lck (store_mtx_);
-        store_.emplace(
-            packet_id,
-            control_packet_type::pubcomp,
-            sb.buf(),
-            std::get<0>(ptr_size),
-            std::get<1>(ptr_size));
+        packet p(make_fixed_header(control_packet_type::pubrel, 0b0010), packet_id);
+        {
+            LockGuard<Mutex> lck (store_mtx_);
+            emplace_stored(
+                packet_id,
+                control_packet_type::pubcomp,
+                p);
+        }
+        async_write(p, func);
     }
 
     template <typename F>
     void async_send_pubcomp(std::uint16_t packet_id, F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pubcomp, 0b0000));
+        packet p(make_fixed_header(control_packet_type::pubcomp, 0b0000), packet_id);
+        if (!h_pub_res_sent_) {
+            // No need to wrap the handler.
+            async_write(p, func);
+            return;
+        }
         auto self = this->shared_from_this();
         async_write(
-            sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size),
+            p,
             [this, self, packet_id, func](boost::system::error_code const& ec){
                 if (func) func(ec);
                 if (h_pub_res_sent_) h_pub_res_sent_(packet_id);
@@ -2914,14 +3517,12 @@ private:
         std::vector<std::tuple<std::reference_wrapper<std::string const>, std::uint8_t>>& params,
         std::uint16_t packet_id,
         F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+        send_buffer sb(send_buffer_pool_);
+        sb.append_uint16(packet_id);
         for (auto const& e : params) {
             if (!utf8string::is_valid_length(std::get<0>(e))) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(std::get<0>(e))) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(std::get<0>(e)));
-            sb.buf()->insert(sb.buf()->size(), std::get<0>(e));
+            if (utf8_check_send_ && !utf8string::is_valid_contents(std::get<0>(e))) throw utf8string_contents_error();
+            sb.append_string(std::get<0>(e));
             sb.buf()->push_back(std::get<1>(e));
         }
         auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::subscribe, 0b0010));
@@ -2942,9 +3543,8 @@ private:
         std::vector<std::uint8_t> const& params,
         std::uint16_t packet_id,
         F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+        send_buffer sb(send_buffer_pool_);
+        sb.append_uint16(packet_id);
         for (auto const& e : params) {
             sb.buf()->push_back(e);
         }
@@ -2967,14 +3567,12 @@ private:
         std::vector<std::reference_wrapper<std::string const>>& params,
         std::uint16_t packet_id,
         F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
+        send_buffer sb(send_buffer_pool_);
+        sb.append_uint16(packet_id);
         for (auto const& e : params) {
             if (!utf8string::is_valid_length(e)) throw utf8string_length_error();
-            if (!utf8string::is_valid_contents(e)) throw utf8string_contents_error();
-            sb.buf()->insert(sb.buf()->size(), encoded_length(e));
-            sb.buf()->insert(sb.buf()->size(), e);
+            if (utf8_check_send_ && !utf8string::is_valid_contents(e)) throw utf8string_contents_error();
+            sb.append_string(e);
         }
         auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::unsubscribe, 0b0010));
         async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
@@ -2983,35 +3581,55 @@ private:
     template <typename F>
     void async_send_unsuback(
         std::uint16_t packet_id, F const& func) {
-        send_buffer sb;
-        sb.buf()->push_back(static_cast<char>(packet_id >> 8));
-        sb.buf()->push_back(static_cast<char>(packet_id & 0xff));
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::unsuback, 0b0010));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
+        packet p(make_fixed_header(control_packet_type::unsuback, 0b0010), packet_id);
+        async_write(p, func);
     }
 
     template <typename F>
     void async_send_pingreq(F const& func) {
-        send_buffer sb;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pingreq, 0b0000));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
+        packet p(make_fixed_header(control_packet_type::pingreq, 0b0000));
+        async_write(p, func);
     }
 
     template <typename F>
     void async_send_pingresp(F const& func) {
-        send_buffer sb;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::pingresp, 0b0000));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
+        packet p(make_fixed_header(control_packet_type::pingresp, 0b0000));
+        async_write(p, func);
     }
     template <typename F>
     void async_send_disconnect(F const& func) {
-        send_buffer sb;
-        auto ptr_size = sb.finalize(make_fixed_header(control_packet_type::disconnect, 0b0000));
-        async_write(sb.buf(), std::get<0>(ptr_size), std::get<1>(ptr_size), func);
+        packet p(make_fixed_header(control_packet_type::disconnect, 0b0000));
+        async_write(p, func);
+    }
+
+    // Append the topic name of the publish packet.
+    // The topic name from topic_handle has been validated and encoded, so it is appended as is.
+    void append_topic_name(send_buffer& sb, topic_view const& topic_name) {
+        if (!topic_name.encoded().empty()) {
+            sb.append(topic_name.encoded());
+            return;
+        }
+        string_view name = topic_name.name();
+        if (!utf8string::is_valid_length(name)) throw utf8string_length_error();
+        if (utf8_check_send_ && !utf8string::is_valid_contents(name)) throw utf8string_contents_error();
+        sb.append_uint16(static_cast<std::uint16_t>(name.size()));
+        sb.append(name);
+    }
+
+    // Return the payload that is kept alive after the caller returns.
+    // If the payload is referred to without ownership, copy it into a pooled buffer.
+    contents_buffer share_payload(contents_buffer const& payload) {
+        if (payload.owner()) return payload;
+        auto buf = send_buffer_pool_.acquire(payload.size());
+        buf->assign(payload.data(), payload.size());
+        return contents_buffer(std::move(buf));
     }
 
     // Non blocking (async) write
 
+    // Maximum bytes of the coalesced packets that are copied into one buffer.
+    static constexpr std::size_t const coalescing_copy_limit = 16 * 1024;
+
     class async_packet {
     public:
         async_packet(
@@ -3021,10 +3639,16 @@ private:
             async_handler_t h = async_handler_t())
             :
         packet_(b, p, s), handler_(h) {}
+        async_packet(
+            packet const& p,
+            async_handler_t h)
+            :
+        packet_(p), handler_(h) {}
         std::shared_ptr<std::string> const& buf() const { return packet_.buf(); }
         char const* ptr() const { return packet_.ptr(); }
         char* ptr() { return packet_.ptr(); }
         std::size_t size() const { return packet_.size(); }
+        std::array<as::const_buffer, 2> const_buffers() const { return packet_.const_buffers(); }
         async_handler_t const& handler() const { return handler_; }
         async_handler_t& handler() { return handler_; }
     private:
@@ -3034,40 +3658,319 @@ private:
 
     template <typename F>
     void async_write(std::shared_ptr<std::string> const& buf, char* ptr, std::size_t size, F const& func) {
+        async_write(packet(buf, ptr, size), func);
+    }
+
+    template <typename F>
+    void async_write(packet const& p, F const& func) {
+        // Counted when posted, so that the publishers on the other threads see it at once.
+        queued_bytes_ += p.size();
+        ++queued_count_;
+        post_write(p, func);
+    }
+
+    // Post the packet that is counted in queued_bytes_ and queued_count_.
+    template <typename F>
+    void post_write(packet const& p, F const& func) {
+        auto size = p.size();
+        auto self = this->shared_from_this();
+        strand_.post(
+            [this, self, p, func, size]
+            () {
+                if (enqueue(p, func, size)) start_write(control_packet_priority_ && is_control_packet(p));
+            }
+        );
+    }
+
+    // Queue the packets by one post. The handlers are not called.
+    void async_write(std::vector<packet> packets) {
+        std::size_t size = 0;
+        for (auto const& p : packets) size += p.size();
+        queued_bytes_ += size;
+        queued_count_ += packets.size();
         auto self = this->shared_from_this();
         strand_.post(
-            [this, self, buf, ptr, size, func]
+            [this, self, packets]
             () {
-                queue_.emplace_back(buf, ptr, size, func);
-                if (queue_.size() > 1) return;
-                async_write();
+                bool queued = false;
+                for (auto const& p : packets) {
+                    if (enqueue(p, async_handler_t(), p.size())) queued = true;
+                }
+                if (queued) start_write(false);
             }
         );
     }
 
+    // Queue the packet that is counted in queued_bytes_ and queued_count_.
+    // Returns false if the packet is rejected by the memory budget.
+    // It is called in the strand.
+    template <typename F>
+    bool enqueue(packet const& p, F const& func, std::size_t size) {
+        if (memory_usage() > memory_budget_) {
+            queued_bytes_ -= size;
+            --queued_count_;
+            send_queue_dequeued();
+            auto ec = boost::system::errc::make_error_code(boost::system::errc::no_buffer_space);
+            if (connected_) handle_close_or_error(ec);
+            async_handler_t h(func);
+            if (h) h(ec);
+            return false;
+        }
+        if (control_packet_priority_ && is_control_packet(p)) {
+            // Queued at the end of the control lane.
+            queue_.emplace(
+                queue_.begin() + static_cast<std::ptrdiff_t>(control_count_),
+                p,
+                func);
+            ++control_count_;
+        }
+        else {
+            queue_.emplace_back(p, func);
+        }
+        if (send_queue_high_) {
+            if (send_queue_policy_ == send_queue_policy::drop_oldest_qos0) drop_oldest_qos0();
+        }
+        else if (over_high_watermark()) {
+            set_send_queue_high(true);
+        }
+        return true;
+    }
+
+    // Start the write of the queued packets unless it is in progress or lingering.
+    // If urgent is true, the linger is finished.
+    // It is called in the strand.
+    void start_write(bool urgent) {
+        if (!writing_.empty() || queue_.empty()) return;
+        bool flush = urgent || queued_bytes_ >= linger_bytes_;
+        if (lingering_) {
+            if (!flush) return;
+            lingering_ = false;
+            linger_timer_.cancel();
+        }
+        else if (linger_delay_ > boost::posix_time::time_duration() && !flush) {
+            start_linger();
+            return;
+        }
+        async_write();
+    }
+
+    static bool is_control_packet(packet const& p) {
+        switch (get_control_packet_type(static_cast<std::uint8_t>(p.ptr()[0]))) {
+        case control_packet_type::puback:
+        case control_packet_type::pubrec:
+        case control_packet_type::pubrel:
+        case control_packet_type::pubcomp:
+        case control_packet_type::pingreq:
+        case control_packet_type::pingresp:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Check the async send queue before a publish packet is built.
+    // Return false if the publish is rejected by the send queue policy.
+    template <typename F>
+    bool admit_publish(std::uint16_t packet_id, F const& func) {
+        if (send_queue_policy_ == send_queue_policy::block) {
+            // The queue could be over the high watermark before the strand notices it.
+            if (!send_queue_high_ && !over_high_watermark()) return true;
+            // The queue is drained in the strand, so waiting in it never wakes up.
+            if (strand_.running_in_this_thread()) return reject_publish(packet_id, func);
+            std::unique_lock<send_queue_mutex> lck (send_queue_mtx_);
+            ++waiting_publishers_;
+            send_queue_cv_.wait(lck, [this] { return !send_queue_high_ && !over_high_watermark(); });
+            --waiting_publishers_;
+            return true;
+        }
+        if (!send_queue_high_ && !over_high_watermark()) return true;
+        switch (send_queue_policy_) {
+        case send_queue_policy::reject:
+            return reject_publish(packet_id, func);
+        default:
+            // The oldest QoS0 publish is dropped when the packet is queued.
+            return true;
+        }
+    }
+
+    // Release the packet id, and call the handler with no_buffer_space.
+    template <typename F>
+    bool reject_publish(std::uint16_t packet_id, F const& func) {
+        release_packet_id(packet_id);
+        async_handler_t h(func);
+        if (h) {
+            auto self = this->shared_from_this();
+            strand_.post(
+                [self, h]
+                () {
+                    h(boost::system::errc::make_error_code(boost::system::errc::no_buffer_space));
+                }
+            );
+        }
+        return false;
+    }
+
+    // Drop the oldest QoS0 publish in the publish lane.
+    void drop_oldest_qos0() {
+        auto b = queue_.begin() + static_cast<std::ptrdiff_t>(control_count_);
+        for (auto it = b; it != queue_.end(); ++it) {
+            std::uint8_t fixed_header = static_cast<std::uint8_t>(it->ptr()[0]);
+            if (get_control_packet_type(fixed_header) != control_packet_type::publish ||
+                publish::get_qos(fixed_header) != qos::at_most_once) continue;
+            auto size = it->size();
+            auto h = std::move(it->handler());
+            queue_.erase(it);
+            queued_bytes_ -= size;
+            --queued_count_;
+            send_queue_dequeued();
+            if (h) h(boost::system::errc::make_error_code(boost::system::errc::operation_canceled));
+            return;
+        }
+    }
+
+    // Called when packets are removed from the queue.
+    // If the queue has fallen to the low watermarks, it is low again.
+    void send_queue_dequeued() {
+        if (send_queue_high_ &&
+            queued_bytes_ <= low_queued_bytes_ && queued_count_ <= low_queued_count_) {
+            set_send_queue_high(false);
+        }
+        notify_waiting_publishers();
+    }
+
+    bool over_high_watermark() const {
+        return queued_bytes_ >= high_queued_bytes_ || queued_count_ >= high_queued_count_;
+    }
+
+    void notify_waiting_publishers() {
+        if (waiting_publishers_ == 0) return;
+        {
+            std::lock_guard<send_queue_mutex> lck (send_queue_mtx_);
+        }
+        send_queue_cv_.notify_all();
+    }
+
+    void set_send_queue_high(bool high) {
+        {
+            std::lock_guard<send_queue_mutex> lck (send_queue_mtx_);
+            send_queue_high_ = high;
+        }
+        if (high) {
+            if (h_send_queue_high_) h_send_queue_high_();
+        }
+        else {
+            send_queue_cv_.notify_all();
+            if (h_send_queue_low_) h_send_queue_low_();
+        }
+    }
+
+    // Wait for the following packets before starting the write.
+    void start_linger() {
+        lingering_ = true;
+        linger_timer_.expires_from_now(linger_delay_);
+        auto self = this->shared_from_this();
+        linger_timer_.async_wait(
+            strand_.wrap(
+                [this, self]
+                (boost::system::error_code const& ec) {
+                    // The linger could have been finished by the queued bytes.
+                    if (ec || !lingering_) return;
+                    lingering_ = false;
+                    if (writing_.empty() && !queue_.empty()) async_write();
+                }
+            )
+        );
+    }
+
+    // Clear the async send queue on error.
+    void clear_queue() {
+        // The packets that are posted but not queued yet are still counted.
+        std::size_t bytes = 0;
+        for (auto const& e : writing_) bytes += e.size();
+        for (auto const& e : queue_) bytes += e.size();
+        queued_bytes_ -= bytes;
+        queued_count_ -= writing_.size() + queue_.size();
+        writing_.clear();
+        queue_.clear();
+        control_count_ = 0;
+        if (lingering_) {
+            lingering_ = false;
+            linger_timer_.cancel();
+        }
+        if (send_queue_high_) set_send_queue_high(false);
+        notify_waiting_publishers();
+    }
+
+    // Refers to write_buffers_ instead of copying it to the write operation.
+    struct write_buffers_ref {
+        using value_type = as::const_buffer;
+        using const_iterator = std::vector<as::const_buffer>::const_iterator;
+        const_iterator begin() const { return buffers->begin(); }
+        const_iterator end() const { return buffers->end(); }
+        std::vector<as::const_buffer> const* buffers;
+    };
+
     void async_write() {
-        auto& elem = queue_.front();
-        auto size = elem.size();
-        auto const& func = elem.handler();
+        // Move the queued packets up to the limits out of queue_.
+        // The buffers refer to the inline bytes of the fixed size packets,
+        // so the packets being written must not be moved by the changes of queue_.
+        std::size_t size = 0;
+        while (!queue_.empty() && writing_.size() != max_coalesced_packets_) {
+            auto const& elem = queue_.front();
+            if (!writing_.empty() && size + elem.size() > max_coalesced_bytes_) break;
+            size += elem.size();
+            writing_.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        std::size_t n = writing_.size();
+        // The control lane is at the front, so it is written first.
+        control_count_ -= std::min(control_count_, n);
+        auto& buffers = write_buffers_;
+        buffers.clear();
+        for (auto const& elem : writing_) {
+            for (auto const& b : elem.const_buffers()) {
+                if (as::buffer_size(b) != 0) buffers.push_back(b);
+            }
+        }
+        if (n > 1 && size <= coalescing_copy_limit) {
+            // Small packets are copied into one contiguous buffer,
+            // because TLS streams write each buffer as a separate record.
+            coalesced_buf_.resize(size);
+            as::buffer_copy(as::buffer(coalesced_buf_), buffers);
+            buffers.assign(1, as::buffer(coalesced_buf_));
+        }
         auto self = this->shared_from_this();
         as::async_write(
             *socket_,
-            as::buffer(elem.ptr(), size),
+            write_buffers_ref { &write_buffers_ },
             strand_.wrap(
-                [this, self, size, func]
+                [this, self, n, size]
                 (boost::system::error_code const& ec,
                  std::size_t bytes_transferred) {
-                    if (func) func(ec);
+                    // The handlers are moved out before they are called, because they can queue packets,
+                    // and start the next write in place if the strand is null_strand.
+                    std::vector<async_handler_t> handlers;
+                    for (auto& elem : writing_) {
+                        if (elem.handler()) handlers.push_back(std::move(elem.handler()));
+                    }
                     if (ec) { // Error is handled by async_read.
-                        queue_.clear();
+                        clear_queue();
+                        for (auto const& h : handlers) h(ec);
                         return;
                     }
                     if (size != bytes_transferred) {
-                        queue_.clear();
+                        clear_queue();
+                        for (auto const& h : handlers) h(ec);
                         throw write_bytes_transferred_error(size, bytes_transferred);
                     }
-                    queue_.pop_front();
-                    if (!queue_.empty()) {
+                    writing_.clear();
+                    queued_bytes_ -= size;
+                    queued_count_ -= n;
+                    send_queue_dequeued();
+                    for (auto const& h : handlers) h(ec);
+                    if (async_resend_ && resending_) resend_stored();
+                    // The write or the linger could have been started by the handlers or the resend.
+                    if (writing_.empty() && !lingering_ && !queue_.empty()) {
                         async_write();
                     }
                 }
@@ -3075,19 +3978,196 @@ private:
         );
     }
 
+    // Store the packet before it is sent, and add it to the session store.
+    // If the session store throws, the packet is kept in memory, and the exception is rethrown.
+    // store_mtx_ should be locked
+    template <typename... Args>
+    void emplace_stored(std::uint16_t packet_id, Args&&... args) {
+        auto ret = store_.emplace(packet_id, packet_id, std::forward<Args>(args)...);
+        if (!ret.second) return;
+        stored_bytes_ += ret.first->size();
+        if (session_store_ && ret.first->size() != 0) {
+            session_store_->add(
+                packet_id,
+                ret.first->expected_control_packet_type(),
+                string_view(ret.first->ptr(), ret.first->header_size()),
+                ret.first->payload().view());
+        }
+    }
+
+    // Store the publish before it is sent.
+    // If the session store throws, the publish is not sent,
+    // so the stored packet, the packet id and the in-flight slot are released.
+    // store_mtx_ should be locked
+    template <typename... Args>
+    void store_publish(std::uint16_t packet_id, Args&&... args) {
+        try {
+            emplace_stored(packet_id, std::forward<Args>(args)...);
+        }
+        catch (...) {
+            // The session store has no live record of it.
+            auto e = store_.find(packet_id);
+            stored_bytes_ -= e->size();
+            store_.erase(packet_id);
+            release_packet_id(packet_id);
+            inflight_.release(packet_id);
+            throw;
+        }
+    }
+
+    // store_mtx_ should be locked
+    void erase_stored(std::uint16_t packet_id) {
+        auto e = store_.find(packet_id);
+        if (!e) return;
+        stored_bytes_ -= e->size();
+        if (session_store_ && e->size() != 0) session_store_->remove(packet_id);
+        store_.erase(packet_id);
+    }
+
+    // Erase the stored packet only if it waits for the expected packet.
+    // store_mtx_ should be locked
+    void erase_stored(std::uint16_t packet_id, std::uint8_t expected_control_packet_type) {
+        auto e = store_.find(packet_id);
+        if (!e || e->expected_control_packet_type() != expected_control_packet_type) return;
+        stored_bytes_ -= e->size();
+        if (session_store_ && e->size() != 0) session_store_->remove(packet_id);
+        store_.erase(packet_id);
+    }
+
+    // The packet ids are acquired and released without store_mtx_.
+    // A packet id is released after its stored packet is erased,
+    // so the stored packet of a newly acquired packet id is always new.
+    // If Mutex is null_mutex, the endpoint is not used concurrently, so the atomic operations are not needed.
+    static constexpr bool const lock_free_packet_id = !std::is_same<Mutex, null_mutex>::value;
+
+    // The counters and the send queue synchronization are selected in the same way.
+    template <typename T>
+    using atomic = typename std::conditional<
+        std::is_same<Mutex, null_mutex>::value, null_atomic<T>, std::atomic<T>>::type;
+    using send_queue_mutex = typename std::conditional<
+        std::is_same<Mutex, null_mutex>::value, null_mutex, std::mutex>::type;
+    using send_queue_condition_variable = typename std::conditional<
+        std::is_same<Mutex, null_mutex>::value, null_condition_variable, std::condition_variable>::type;
+
+    // Enter the publish to the in-flight window. If the window is full, or the other publishes
+    // are waiting, returns false, and the caller queues the publish to inflight_waiting_.
+    // The resends (dup) always enter.
+    // store_mtx_ should be locked
+    bool enter_inflight(std::uint16_t packet_id, bool dup) {
+        if (max_inflight_ != 0 && !dup &&
+            (inflight_.size() >= max_inflight_ || !inflight_waiting_.empty())) {
+            inflight_full_ = true;
+            return false;
+        }
+        inflight_.reserve(packet_id);
+        if (max_inflight_ != 0 && inflight_.size() >= max_inflight_) inflight_full_ = true;
+        return true;
+    }
+
+    // Resend the packets in resend_, and then send the publishes waiting for the in-flight window.
+    // The packets are taken by the write coalescing limits, and written without locking store_mtx_.
+    // The packets completed or released meanwhile are skipped.
+    // If async_resend_ is true, each batch is queued to the async send queue by one post while the queue is
+    // under the high watermark, and the rest is queued when the queued packets are written.
+    // The batch is posted while locking store_mtx_, so the batches are queued in order.
+    // Otherwise, each batch is written by one blocking write.
+    void resend_stored() {
+        std::vector<packet> packets;
+        std::vector<as::const_buffer> buffers;
+        while (true) {
+            if (async_resend_ && connected_ && over_high_watermark()) return;
+            {
+                LockGuard<Mutex> lck (store_mtx_);
+                if (!connected_) resend_.clear();
+                if (resend_.empty()) {
+                    // The other thread could have finished the resend.
+                    if (!resending_.exchange(false)) return;
+                    break;
+                }
+                std::size_t size = 0;
+                while (!resend_.empty() && packets.size() != max_coalesced_packets_) {
+                    auto const& r = resend_.front();
+                    auto e = store_.find(r.packet_id());
+                    if (e && e->buf() == r.buf()) {
+                        if (!packets.empty() && size + r.size() > max_coalesced_bytes_) break;
+                        packets.push_back(r.stored_packet());
+                        size += r.size();
+                    }
+                    resend_.pop_front();
+                }
+                if (async_resend_) {
+                    if (!packets.empty()) async_write(std::move(packets));
+                    packets.clear();
+                    continue;
+                }
+            }
+            buffers.clear();
+            for (auto const& p : packets) {
+                for (auto const& b : p.const_buffers()) {
+                    if (as::buffer_size(b) != 0) buffers.push_back(b);
+                }
+            }
+            if (!buffers.empty()) write(buffers);
+            packets.clear();
+        }
+        send_waiting_publishes();
+    }
+
+    // Send the publishes that wait for the room of the in-flight window.
+    // If the window has room again after it has been full, the in-flight room handler is called.
+    void send_waiting_publishes() {
+        if (!inflight_full_) return;
+        bool room = false;
+        while (connected_) {
+            waiting_publish w {};
+            try {
+                LockGuard<Mutex> lck (store_mtx_);
+                if (max_inflight_ != 0 && inflight_.size() >= max_inflight_) break;
+                if (inflight_waiting_.empty()) {
+                    room = inflight_full_.exchange(false);
+                    break;
+                }
+                w = std::move(inflight_waiting_.front());
+                inflight_waiting_.pop_front();
+                inflight_.reserve(w.packet_id);
+                // The blocking one is counted as a stored packet while waiting.
+                if (!w.async) stored_bytes_ -= w.p.size();
+                store_publish(w.packet_id, w.expected_control_packet_type, w.p);
+            }
+            catch (...) {
+                if (w.async) {
+                    // It has been counted in the async send queue while waiting.
+                    queued_bytes_ -= w.p.size();
+                    --queued_count_;
+                    send_queue_dequeued();
+                }
+                throw;
+            }
+            if (w.async) {
+                // It has been counted in the async send queue while waiting.
+                post_write(w.p, w.func);
+            }
+            else {
+                write(w.p.const_buffers());
+                LockGuard<Mutex> lck (store_mtx_);
+                // The stored packet shares the buffer.
+                *w.p.ptr() |= 0b00001000; // set DUP flag for resending
+            }
+        }
+        if (room && h_inflight_room_) h_inflight_room_();
+    }
+
     std::uint16_t acquire_unique_packet_id() {
-        LockGuard<Mutex> lck (store_mtx_);
-        if (packet_id_.size() == 0xffff - 1) throw packet_id_exhausted_error();
-        do {
-            if (++packet_id_master_ == 0) ++packet_id_master_;
-        } while (!packet_id_.insert(packet_id_master_).second);
-        return packet_id_master_;
+        return lock_free_packet_id ? packet_id_.acquire_lock_free() : packet_id_.acquire();
     }
 
     bool register_packet_id(std::uint16_t packet_id) {
-        if (packet_id == 0) return false;
-        LockGuard<Mutex> lck (store_mtx_);
-        return packet_id_.insert(packet_id).second;
+        return lock_free_packet_id ? packet_id_.reserve_lock_free(packet_id) : packet_id_.reserve(packet_id);
+    }
+
+    void release_packet_id(std::uint16_t packet_id) {
+        if (lock_free_packet_id) packet_id_.release_lock_free(packet_id);
+        else packet_id_.release(packet_id);
     }
 
     static std::uint16_t make_uint16_t(char b1, char b2) {
@@ -3105,21 +4185,60 @@ private:
     std::string client_id_;
     bool clean_session_;
     boost::optional<will> will_;
-    char buf_;
-    std::uint8_t fixed_header_;
-    std::size_t remaining_length_multiplier_;
-    std::size_t remaining_length_;
-    std::vector<char> payload_;
+    std::shared_ptr<std::vector<char>> read_buf_;
+    std::size_t read_begin_;
+    std::size_t read_end_;
+    std::size_t read_required_;
+    std::size_t read_buffer_size_;
+    buffer_pool read_buffer_pool_;
+    mqtt::send_buffer_pool send_buffer_pool_;
+    packet_parser parser_;
+    bool chunk_deliver_;
+    std::uint8_t chunk_qos_;
+    boost::optional<std::uint16_t> chunk_packet_id_;
+    std::size_t memory_budget_;
+    bool read_buffer_shrink_;
+    bool utf8_check_send_;
+    std::size_t max_coalesced_packets_;
+    std::size_t max_coalesced_bytes_;
+    // The batch can be opened on another thread than the one that handles the received packets.
+    mutable Mutex batch_mtx_;
+    bool batching_;
+    std::vector<char> batch_buf_;
+    atomic<std::size_t> read_buffer_bytes_;
+    atomic<std::size_t> queued_bytes_;
+    atomic<std::size_t> stored_bytes_;
+    std::size_t high_queued_bytes_;
+    std::size_t low_queued_bytes_;
+    std::size_t high_queued_count_;
+    std::size_t low_queued_count_;
+    send_queue_policy send_queue_policy_;
+    atomic<std::size_t> queued_count_;
+    atomic<bool> send_queue_high_;
+    send_queue_mutex send_queue_mtx_;
+    send_queue_condition_variable send_queue_cv_;
+    atomic<std::size_t> waiting_publishers_;
+    bool control_packet_priority_;
+    boost::posix_time::time_duration linger_delay_;
+    std::size_t linger_bytes_;
+    std::size_t max_inflight_;
     close_handler h_close_;
     error_handler h_error_;
     connect_handler h_connect_;
     connack_handler h_connack_;
     publish_handler h_publish_;
+    publish_view_handler h_publish_view_;
+    publish_buffer_handler h_publish_buffer_;
+    publish_begin_handler h_publish_begin_;
+    publish_chunk_handler h_publish_chunk_;
     puback_handler h_puback_;
     pubrec_handler h_pubrec_;
     pubrel_handler h_pubrel_;
     pubcomp_handler h_pubcomp_;
     pub_res_sent_handler h_pub_res_sent_;
+    send_queue_high_handler h_send_queue_high_;
+    send_queue_low_handler h_send_queue_low_;
+    inflight_room_handler h_inflight_room_;
     subscribe_handler h_subscribe_;
     suback_handler h_suback_;
     unsubscribe_handler h_unsubscribe_;
@@ -3130,13 +4249,33 @@ private:
     boost::optional<std::string> user_name_;
     boost::optional<std::string> password_;
     Mutex store_mtx_;
-    mi_store store_;
+    flat_store<store> store_;
+    // The packet ids of the QoS1 and QoS2 publishes in flight. It is guarded by store_mtx_.
+    packet_id_allocator inflight_;
+    // The publishes that wait for the room of the in-flight window. It is guarded by store_mtx_.
+    std::deque<waiting_publish> inflight_waiting_;
+    atomic<bool> inflight_full_;
+    // It is guarded by store_mtx_.
+    std::shared_ptr<session_store> session_store_;
     std::set<std::uint16_t> qos2_publish_handled_;
-    std::deque<async_packet> queue_;
-    std::uint16_t packet_id_master_;
-    std::set<std::uint16_t> packet_id_;
+    std::deque<async_packet, mqtt::send_buffer_pool::allocator<async_packet>> queue_;
+    // queue_ consists of the control lane and the publish lane.
+    // The number of the packets in the control lane at the front of queue_.
+    std::size_t control_count_;
+    // The packets being written. They are not moved until the write is finished.
+    std::vector<async_packet> writing_;
+    bool lingering_;
+    as::deadline_timer linger_timer_;
+    std::vector<as::const_buffer> write_buffers_;
+    std::vector<char> coalesced_buf_;
+    packet_id_allocator packet_id_;
     bool auto_pub_response_;
     bool auto_pub_response_async_;
+    bool async_resend_;
+    // The stored packets to be resent after CONNACK. It is guarded by store_mtx_.
+    std::deque<store> resend_;
+    // True from CONNACK until the resend is finished.
+    atomic<bool> resending_;
 };
 
 } // namespace mqtt
@@ -9,6 +9,8 @@
 
 #include <exception>
 #include <sstream>
+#include <string>
+#include <cstring>
 
 #include <boost/system/error_code.hpp>
 
@@ -82,6 +84,18 @@ struct packet_id_exhausted_error : std::exception {
     }
 };
 
+struct session_store_error : std::exception {
+    session_store_error(std::string const& operation, std::string const& path, int err) {
+        std::stringstream ss;
+        ss << "session store error. " << operation << " " << path << ": " << std::strerror(err);
+        msg = ss.str();
+    }
+    virtual char const* what() const noexcept {
+        return msg.data();
+    }
+    std::string msg;
+};
+
 } // namespace mqtt
 
 #endif // MQTT_EXCEPTION_HPP
@@ -0,0 +1,201 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_FLAT_STORE_HPP)
+#define MQTT_FLAT_STORE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+#include <boost/optional.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Container that holds at most one value per packet id, in insertion order.
+ *
+ * The value is found by a table indexed directly by the packet id, and the values are linked
+ * by an intrusive list in insertion order. Insert, find, and erase are O(1).<BR>
+ * The values are held in a vector of slots, and the erased slots are reused,
+ * so no memory is allocated per value after the vector has grown.<BR>
+ * The table of 64Ki indexes is allocated on the first insertion.
+ */
+template <typename T>
+class flat_store {
+    static constexpr std::uint16_t const npos = 0xffff;
+
+    struct slot {
+        boost::optional<T> value;
+        std::uint16_t packet_id;
+        std::uint16_t prev;
+        std::uint16_t next;
+    };
+
+public:
+    template <typename Slots, typename Value>
+    class basic_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        basic_iterator(Slots* slots, std::uint16_t index):slots_(slots), index_(index) {}
+
+        reference operator*() const { return *(*slots_)[index_].value; }
+        pointer operator->() const { return &*(*slots_)[index_].value; }
+        basic_iterator& operator++() {
+            index_ = (*slots_)[index_].next;
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(basic_iterator const& other) const { return index_ == other.index_; }
+        bool operator!=(basic_iterator const& other) const { return index_ != other.index_; }
+
+    private:
+        friend class flat_store;
+        Slots* slots_;
+        std::uint16_t index_;
+    };
+
+    using iterator = basic_iterator<std::vector<slot>, T>;
+    using const_iterator = basic_iterator<std::vector<slot> const, T const>;
+
+    flat_store()
+        :head_(npos),
+         tail_(npos),
+         free_(npos),
+         size_(0) {}
+
+    iterator begin() { return iterator(&slots_, head_); }
+    iterator end() { return iterator(&slots_, npos); }
+    const_iterator begin() const { return const_iterator(&slots_, head_); }
+    const_iterator end() const { return const_iterator(&slots_, npos); }
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * @brief Insert a value at the end.
+     * @param packet_id packet id of the value. It should not be 0.
+     * @param args arguments of the constructor of the value
+     * @return the inserted value and true, or the value that already has packet_id and false
+     */
+    template <typename... Args>
+    std::pair<T*, bool> emplace(std::uint16_t packet_id, Args&&... args) {
+        if (!table_) {
+            table_.reset(new std::uint16_t[0x10000]);
+            std::fill(table_.get(), table_.get() + 0x10000, npos);
+        }
+        std::uint16_t index = table_[packet_id];
+        if (index != npos) return std::make_pair(&*slots_[index].value, false);
+        if (free_ != npos) {
+            index = free_;
+            free_ = slots_[index].next;
+        }
+        else {
+            index = static_cast<std::uint16_t>(slots_.size());
+            slots_.emplace_back();
+        }
+        auto& s = slots_[index];
+        s.value.emplace(std::forward<Args>(args)...);
+        s.packet_id = packet_id;
+        s.prev = tail_;
+        s.next = npos;
+        if (tail_ == npos) head_ = index;
+        else slots_[tail_].next = index;
+        tail_ = index;
+        table_[packet_id] = index;
+        ++size_;
+        return std::make_pair(&*s.value, true);
+    }
+
+    /**
+     * @brief Find the value.
+     * @param packet_id packet id
+     * @return the value, or nullptr if not found
+     */
+    T* find(std::uint16_t packet_id) {
+        if (!table_) return nullptr;
+        std::uint16_t index = table_[packet_id];
+        return index == npos ? nullptr : &*slots_[index].value;
+    }
+
+    T const* find(std::uint16_t packet_id) const {
+        return const_cast<flat_store*>(this)->find(packet_id);
+    }
+
+    /**
+     * @brief Erase the value.
+     * @param packet_id packet id
+     * @return true if the value is erased
+     */
+    bool erase(std::uint16_t packet_id) {
+        if (!table_) return false;
+        std::uint16_t index = table_[packet_id];
+        if (index == npos) return false;
+        unlink(index);
+        return true;
+    }
+
+    /**
+     * @brief Erase the value.
+     * @param it iterator of the value
+     * @return iterator of the next value
+     */
+    iterator erase(iterator it) {
+        std::uint16_t next = slots_[it.index_].next;
+        unlink(it.index_);
+        return iterator(&slots_, next);
+    }
+
+    void clear() {
+        for (auto index = head_; index != npos; index = slots_[index].next) {
+            table_[slots_[index].packet_id] = npos;
+        }
+        slots_.clear();
+        head_ = tail_ = free_ = npos;
+        size_ = 0;
+    }
+
+private:
+    void unlink(std::uint16_t index) {
+        auto& s = slots_[index];
+        if (s.prev == npos) head_ = s.next;
+        else slots_[s.prev].next = s.next;
+        if (s.next == npos) tail_ = s.prev;
+        else slots_[s.next].prev = s.prev;
+        table_[s.packet_id] = npos;
+        s.value = boost::none;
+        s.next = free_;
+        free_ = index;
+        --size_;
+    }
+
+    std::unique_ptr<std::uint16_t[]> table_;
+    std::vector<slot> slots_;
+    std::uint16_t head_;
+    std::uint16_t tail_;
+    std::uint16_t free_;
+    std::size_t size_;
+};
+
+template <typename T>
+constexpr std::uint16_t const flat_store<T>::npos;
+
+} // namespace mqtt
+
+#endif // MQTT_FLAT_STORE_HPP
@@ -0,0 +1,560 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_LOG_SESSION_STORE_HPP)
+#define MQTT_LOG_SESSION_STORE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <chrono>
+#include <utility>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#else  // defined(_WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#endif // defined(_WIN32)
+
+#include <boost/crc.hpp>
+#include <boost/optional.hpp>
+
+#include <mqtt/session_store.hpp>
+#include <mqtt/flat_store.hpp>
+#include <mqtt/exception.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief When the log is flushed to the storage device by fsync.
+ */
+enum class fsync_policy {
+    /**
+     * @brief Each record is written to the file, and never fsynced.
+     *        The records survive the process crash but may be lost by the OS crash.
+     */
+    never,
+    /**
+     * @brief Each record is written to the file, and the records are fsynced together (group commit)
+     *        when the number of the unsynced records reaches the batch size, or the batch interval
+     *        has passed since the last commit when a record is added.
+     *        The records survive the process crash. There is no timer, so the last records after
+     *        an idle period are not fsynced until the next record or commit().
+     */
+    batched,
+    /**
+     * @brief Each record is written and fsynced before returning.
+     */
+    always
+};
+
+/**
+ * @brief Session store that appends the records to a log file.
+ *
+ * The file consists of a magic number and the records. Each record is one of add, remove, and clear,
+ * and ends with CRC-32. On construction, the file is read from the beginning to recover the stored packets.
+ * The torn record at the end, that is left by the crash while writing, is truncated.<BR>
+ * The removed records remain in the file until compaction. When the file size exceeds
+ * the compaction ratio times the size of the live records, the live records are written
+ * to a new file, and it replaces the log atomically by rename.<BR>
+ * It is not thread safe by itself. The endpoint calls it while locking the stored packets.
+ */
+class log_session_store : public session_store {
+public:
+    /**
+     * @brief Constructor
+     * @param path path of the log file. If it doesn't exist, it is created.
+     * @param policy fsync policy
+     * @param batch_records the batch size of fsync_policy::batched
+     * @param batch_interval the batch interval of fsync_policy::batched
+     *
+     * If the file can't be opened or isn't a log file, session_store_error is thrown.
+     */
+    explicit log_session_store(
+        std::string path,
+        fsync_policy policy = fsync_policy::batched,
+        std::size_t batch_records = 64,
+        std::chrono::steady_clock::duration batch_interval = std::chrono::milliseconds(10))
+        :path_(std::move(path)),
+         policy_(policy),
+         batch_records_(batch_records),
+         batch_interval_(batch_interval),
+         fp_(nullptr),
+         failed_(false),
+         file_size_(0),
+         live_bytes_(magic_size),
+         pending_records_(0),
+         unsynced_(false),
+         last_commit_(std::chrono::steady_clock::now()),
+         compaction_min_bytes_(1024 * 1024),
+         compaction_ratio_(4) {
+        open();
+        recover();
+    }
+
+    ~log_session_store() {
+        try {
+            commit();
+        }
+        catch (...) {
+        }
+        if (fp_) std::fclose(fp_);
+    }
+
+    log_session_store(log_session_store const&) = delete;
+    log_session_store& operator=(log_session_store const&) = delete;
+
+    void add(
+        std::uint16_t packet_id,
+        std::uint8_t expected_control_packet_type,
+        string_view header,
+        string_view payload) override {
+        check_failed();
+        // Restored if the record can't be written, so that the packet is not left live.
+        auto prev = live_.find(packet_id);
+        boost::optional<location> prev_location;
+        if (prev) prev_location = *prev;
+        std::size_t prev_pending_records = pending_records_;
+        erase_live(packet_id);
+        std::size_t size = header.size() + payload.size();
+        std::uint64_t begin = file_size_ + buf_.size();
+        append('A', packet_id, expected_control_packet_type, header, payload);
+        live_.emplace(
+            packet_id,
+            location { packet_id, expected_control_packet_type, begin + record_header_size, static_cast<std::uint32_t>(size) });
+        live_bytes_ += record_size(size);
+        try {
+            written();
+        }
+        catch (...) {
+            erase_live(packet_id);
+            if (prev_location) {
+                live_.emplace(packet_id, *prev_location);
+                live_bytes_ += record_size(prev_location->size);
+            }
+            pending_records_ = prev_pending_records;
+            discard_from(begin);
+            throw;
+        }
+    }
+
+    void remove(std::uint16_t packet_id) override {
+        check_failed();
+        if (!erase_live(packet_id)) return;
+        append('R', packet_id, 0, string_view(), string_view());
+        written();
+    }
+
+    void clear() override {
+        check_failed();
+        append('C', 0, 0, string_view(), string_view());
+        live_.clear();
+        live_bytes_ = magic_size;
+        written();
+    }
+
+    void for_each(for_each_handler const& f) override {
+        check_failed();
+        write_buffer();
+        for (auto const& e : live_) {
+            f(e.packet_id, e.expected_control_packet_type, read_at(e.offset, e.size));
+        }
+    }
+
+    /**
+     * @brief Write the buffered records and fsync the file.
+     */
+    void commit() {
+        check_failed();
+        write_buffer();
+        if (unsynced_) {
+            sync(fp_, path_);
+            unsynced_ = false;
+        }
+        pending_records_ = 0;
+        last_commit_ = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * @brief Rewrite the log file with the live records only.
+     *
+     * If it fails, the log file is kept, and session_store_error is thrown.
+     */
+    void compact() {
+        commit();
+        std::string tmp_path = path_ + ".tmp";
+        // The compacted file is opened for the log before the rename.
+        std::FILE* out = std::fopen(tmp_path.c_str(), "w+b");
+        if (!out) throw session_store_error("open", tmp_path, errno);
+        flat_store<location> live;
+        std::uint64_t size = magic_size;
+        try {
+            std::string rec(magic(), magic_size);
+            for (auto const& e : live_) {
+                std::string packet = read_at(e.offset, e.size);
+                live.emplace(
+                    e.packet_id,
+                    location { e.packet_id, e.expected_control_packet_type, size + record_header_size, e.size });
+                encode_record(rec, 'A', e.packet_id, e.expected_control_packet_type, packet, string_view());
+                size += record_size(e.size);
+                if (rec.size() >= 64 * 1024) {
+                    write_all(out, rec, tmp_path);
+                    rec.clear();
+                }
+            }
+            write_all(out, rec, tmp_path);
+            sync(out, tmp_path);
+        }
+        catch (...) {
+            std::fclose(out);
+            std::remove(tmp_path.c_str());
+            throw;
+        }
+        replace(out, tmp_path);
+        live_ = std::move(live);
+        file_size_ = size;
+        live_bytes_ = size;
+    }
+
+    /**
+     * @brief Set when the log file is compacted.
+     * @param min_bytes the file is not compacted while it is smaller than min_bytes
+     * @param ratio the file is compacted when its size exceeds ratio times the size of the live records
+     *
+     * The default is 1MiB and 4. If ratio is 0, the file is compacted only by compact().
+     */
+    void set_compaction(std::uint64_t min_bytes, std::size_t ratio) {
+        compaction_min_bytes_ = min_bytes;
+        compaction_ratio_ = ratio;
+    }
+
+    /**
+     * @brief Get the number of the stored packets.
+     */
+    std::size_t size() const {
+        return live_.size();
+    }
+
+    /**
+     * @brief Get the size of the log including the buffered records.
+     */
+    std::uint64_t file_size() const {
+        return file_size_ + buf_.size();
+    }
+
+private:
+    // Enumerators are never odr-used, so the header can be included by many translation units.
+    enum : std::size_t {
+        magic_size = 8,
+        // kind(1) packet_id(2) expected_control_packet_type(1) length(4)
+        record_header_size = 8,
+        crc_size = 4,
+        max_packet_size = 268435455 + 5
+    };
+
+    static char const* magic() {
+        return "MQTTSS01";
+    }
+
+    struct location {
+        std::uint16_t packet_id;
+        std::uint8_t expected_control_packet_type;
+        std::uint64_t offset;
+        std::uint32_t size;
+    };
+
+    static std::uint64_t record_size(std::size_t packet_size) {
+        return record_header_size + packet_size + crc_size;
+    }
+
+    static void put_uint32(std::string& s, std::uint32_t v) {
+        s.push_back(static_cast<char>(v >> 24));
+        s.push_back(static_cast<char>(v >> 16));
+        s.push_back(static_cast<char>(v >> 8));
+        s.push_back(static_cast<char>(v));
+    }
+
+    static std::uint32_t get_uint32(char const* p) {
+        return
+            static_cast<std::uint32_t>(static_cast<unsigned char>(p[0])) << 24 |
+            static_cast<std::uint32_t>(static_cast<unsigned char>(p[1])) << 16 |
+            static_cast<std::uint32_t>(static_cast<unsigned char>(p[2])) << 8 |
+            static_cast<std::uint32_t>(static_cast<unsigned char>(p[3]));
+    }
+
+    static std::uint32_t crc(char const* p, std::size_t size) {
+        boost::crc_32_type c;
+        c.process_bytes(p, size);
+        return c.checksum();
+    }
+
+    static void encode_record(
+        std::string& s,
+        char kind,
+        std::uint16_t packet_id,
+        std::uint8_t expected_control_packet_type,
+        string_view header,
+        string_view payload) {
+        std::size_t begin = s.size();
+        s.push_back(kind);
+        s.push_back(static_cast<char>(packet_id >> 8));
+        s.push_back(static_cast<char>(packet_id & 0xff));
+        s.push_back(static_cast<char>(expected_control_packet_type));
+        put_uint32(s, static_cast<std::uint32_t>(header.size() + payload.size()));
+        s.append(header.data(), header.size());
+        s.append(payload.data(), payload.size());
+        put_uint32(s, crc(s.data() + begin, s.size() - begin));
+    }
+
+    static void sync(std::FILE* fp, std::string const& path) {
+        if (std::fflush(fp) != 0) throw session_store_error("flush", path, errno);
+#if defined(_WIN32)
+        if (_commit(_fileno(fp)) != 0) throw session_store_error("fsync", path, errno);
+#else  // defined(_WIN32)
+        if (::fsync(fileno(fp)) != 0) throw session_store_error("fsync", path, errno);
+#endif // defined(_WIN32)
+    }
+
+    // Replace the log file with the compacted file out, and use it as the log.
+    // If the rename fails, the log file is kept open, and session_store_error is thrown.
+    void replace(std::FILE* out, std::string const& tmp_path) {
+#if defined(_WIN32)
+        // The open files can't be renamed, so the log is reopened.
+        std::fclose(out);
+        std::fclose(fp_);
+        fp_ = nullptr;
+        bool moved =
+            MoveFileExA(tmp_path.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+        if (!moved) std::remove(tmp_path.c_str());
+        try {
+            open();
+        }
+        catch (...) {
+            // The records can't be written to the log any more.
+            failed_ = true;
+            throw;
+        }
+        if (!moved) throw session_store_error("rename", tmp_path, EIO);
+#else  // defined(_WIN32)
+        if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+            int err = errno;
+            std::fclose(out);
+            std::remove(tmp_path.c_str());
+            throw session_store_error("rename", tmp_path, err);
+        }
+        sync_directory();
+        std::fclose(fp_);
+        fp_ = out;
+#endif // defined(_WIN32)
+    }
+
+    // The store is failed if the log file can't be reopened or restored.
+    void check_failed() const {
+        if (failed_) throw session_store_error("write", path_, EIO);
+    }
+
+    // Make the rename of the compaction durable.
+    void sync_directory() {
+#if !defined(_WIN32)
+        auto pos = path_.find_last_of('/');
+        std::string dir = pos == std::string::npos ? "." : path_.substr(0, pos == 0 ? 1 : pos);
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        ::fsync(fd);
+        ::close(fd);
+#endif // !defined(_WIN32)
+    }
+
+    static void write_all(std::FILE* fp, std::string const& s, std::string const& path) {
+        if (s.empty()) return;
+        if (std::fwrite(s.data(), 1, s.size(), fp) != s.size() || std::fflush(fp) != 0) {
+            throw session_store_error("write", path, errno);
+        }
+    }
+
+    void open() {
+        fp_ = std::fopen(path_.c_str(), "r+b");
+        if (!fp_) {
+            if (errno != ENOENT) throw session_store_error("open", path_, errno);
+            fp_ = std::fopen(path_.c_str(), "w+b");
+            if (!fp_) throw session_store_error("open", path_, errno);
+        }
+    }
+
+    void recover() {
+        char m[magic_size];
+        std::size_t n = std::fread(m, 1, magic_size, fp_);
+        if (n == 0) {
+            // New file
+            std::fseek(fp_, 0, SEEK_SET);
+            write_all(fp_, std::string(magic(), magic_size), path_);
+            sync(fp_, path_);
+            file_size_ = magic_size;
+            return;
+        }
+        if (n != magic_size || std::string(m, magic_size) != magic()) {
+            throw session_store_error("recover", path_, EILSEQ);
+        }
+        std::uint64_t pos = magic_size;
+        std::string rec;
+        while (true) {
+            rec.resize(record_header_size);
+            if (std::fread(&rec[0], 1, record_header_size, fp_) != record_header_size) break;
+            std::uint32_t size = get_uint32(rec.data() + 4);
+            if (size > max_packet_size) break;
+            rec.resize(record_header_size + size + crc_size);
+            if (std::fread(&rec[record_header_size], 1, size + crc_size, fp_) != size + crc_size) break;
+            if (crc(rec.data(), record_header_size + size) != get_uint32(rec.data() + record_header_size + size)) break;
+            char kind = rec[0];
+            std::uint16_t packet_id = static_cast<std::uint16_t>(
+                static_cast<unsigned char>(rec[1]) << 8 | static_cast<unsigned char>(rec[2]));
+            std::uint8_t expected_control_packet_type = static_cast<std::uint8_t>(rec[3]);
+            if (kind == 'A') {
+                erase_live(packet_id);
+                live_.emplace(
+                    packet_id,
+                    location { packet_id, expected_control_packet_type, pos + record_header_size, size });
+                live_bytes_ += record_size(size);
+            }
+            else if (kind == 'R') {
+                erase_live(packet_id);
+            }
+            else if (kind == 'C') {
+                live_.clear();
+                live_bytes_ = magic_size;
+            }
+            else {
+                break;
+            }
+            pos += record_size(size);
+        }
+        std::fseek(fp_, 0, SEEK_END);
+        if (static_cast<std::uint64_t>(std::ftell(fp_)) != pos) {
+            // Truncate the torn record.
+            truncate(pos);
+            sync(fp_, path_);
+        }
+        file_size_ = pos;
+    }
+
+    void truncate(std::uint64_t size) {
+        std::fflush(fp_);
+#if defined(_WIN32)
+        if (_chsize_s(_fileno(fp_), static_cast<long long>(size)) != 0) {
+            throw session_store_error("truncate", path_, errno);
+        }
+#else  // defined(_WIN32)
+        if (::ftruncate(fileno(fp_), static_cast<off_t>(size)) != 0) {
+            throw session_store_error("truncate", path_, errno);
+        }
+#endif // defined(_WIN32)
+    }
+
+    // Discard the records from the position begin, whether they are written to the file or not.
+    // If the file can't be truncated, the store is failed.
+    void discard_from(std::uint64_t begin) {
+        if (begin < file_size_) {
+            file_size_ = begin;
+        }
+        else {
+            buf_.resize(static_cast<std::size_t>(begin - file_size_));
+        }
+        // The records could have been written partially, or fsynced.
+        try {
+            truncate(file_size_);
+            sync(fp_, path_);
+        }
+        catch (...) {
+            failed_ = true;
+            return;
+        }
+        unsynced_ = false;
+    }
+
+    bool erase_live(std::uint16_t packet_id) {
+        auto e = live_.find(packet_id);
+        if (!e) return false;
+        live_bytes_ -= record_size(e->size);
+        live_.erase(packet_id);
+        return true;
+    }
+
+    void append(
+        char kind,
+        std::uint16_t packet_id,
+        std::uint8_t expected_control_packet_type,
+        string_view header,
+        string_view payload) {
+        encode_record(buf_, kind, packet_id, expected_control_packet_type, header, payload);
+        ++pending_records_;
+    }
+
+    // Called after a record is appended.
+    void written() {
+        switch (policy_) {
+        case fsync_policy::never:
+            write_buffer();
+            break;
+        case fsync_policy::batched:
+            write_buffer();
+            if (pending_records_ >= batch_records_ ||
+                std::chrono::steady_clock::now() - last_commit_ >= batch_interval_) {
+                commit();
+            }
+            break;
+        case fsync_policy::always:
+            commit();
+            break;
+        }
+        if (compaction_ratio_ != 0 &&
+            file_size() >= compaction_min_bytes_ &&
+            file_size() > live_bytes_ * compaction_ratio_) {
+            compact();
+        }
+    }
+
+    void write_buffer() {
+        if (buf_.empty()) return;
+        std::fseek(fp_, static_cast<long>(file_size_), SEEK_SET);
+        write_all(fp_, buf_, path_);
+        file_size_ += buf_.size();
+        buf_.clear();
+        unsynced_ = true;
+    }
+
+    std::string read_at(std::uint64_t offset, std::uint32_t size) {
+        std::string s(size, '\0');
+        std::fseek(fp_, static_cast<long>(offset), SEEK_SET);
+        if (size != 0 && std::fread(&s[0], 1, size, fp_) != size) throw session_store_error("read", path_, EIO);
+        return s;
+    }
+
+    std::string path_;
+    fsync_policy policy_;
+    std::size_t batch_records_;
+    std::chrono::steady_clock::duration batch_interval_;
+    std::FILE* fp_;
+    bool failed_;
+    flat_store<location> live_;
+    // The size of the records written to the file.
+    std::uint64_t file_size_;
+    // The size that the file would have after compaction.
+    std::uint64_t live_bytes_;
+    // The records that are not written to the file yet.
+    std::string buf_;
+    std::size_t pending_records_;
+    bool unsynced_;
+    std::chrono::steady_clock::time_point last_commit_;
+    std::uint64_t compaction_min_bytes_;
+    std::size_t compaction_ratio_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_LOG_SESSION_STORE_HPP
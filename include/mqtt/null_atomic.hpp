@@ -0,0 +1,43 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_NULL_ATOMIC_HPP)
+#define MQTT_NULL_ATOMIC_HPP
+
+namespace mqtt {
+
+/**
+ * @brief Plain value that has the subset of the std::atomic interface used by the endpoint.
+ *        It is used instead of std::atomic when the endpoint is not used concurrently.
+ */
+template <typename T>
+class null_atomic {
+public:
+    null_atomic(T v):v_(v) {}
+    null_atomic(null_atomic const&) = delete;
+    null_atomic& operator=(null_atomic const&) = delete;
+
+    operator T() const { return v_; }
+    T load() const { return v_; }
+    void store(T v) { v_ = v; }
+    T exchange(T v) {
+        T old = v_;
+        v_ = v;
+        return old;
+    }
+    T operator=(T v) { return v_ = v; }
+    T operator+=(T v) { return v_ += v; }
+    T operator-=(T v) { return v_ -= v; }
+    T operator++() { return ++v_; }
+    T operator--() { return --v_; }
+
+private:
+    T v_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_NULL_ATOMIC_HPP
@@ -0,0 +1,32 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_NULL_MUTEX_HPP)
+#define MQTT_NULL_MUTEX_HPP
+
+namespace mqtt {
+
+struct null_mutex {
+    void lock() {}
+    void unlock() {}
+    bool try_lock() { return true; }
+};
+
+/**
+ * @brief Condition variable for null_mutex.
+ *        Nothing can change the condition while waiting without the other threads,
+ *        so wait() returns immediately.
+ */
+struct null_condition_variable {
+    template <typename Lock, typename Predicate>
+    void wait(Lock&, Predicate) {}
+    void notify_one() {}
+    void notify_all() {}
+};
+
+} // namespace mqtt
+
+#endif // MQTT_NULL_MUTEX_HPP
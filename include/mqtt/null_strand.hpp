@@ -23,6 +23,10 @@ struct null_strand {
     Func const& wrap(Func const&f) {
         return f;
     }
+    // Without the strand, everything runs on the thread of the io_service.
+    bool running_in_this_thread() const {
+        return true;
+    }
 };
 
 } // namespace mqtt
@@ -0,0 +1,194 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_PACKET_ID_ALLOCATOR_HPP)
+#define MQTT_PACKET_ID_ALLOCATOR_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <mqtt/exception.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Allocator of the packet ids 1..65535.
+ *
+ * The ids in use are kept in a bitmap of 64Ki bits. acquire() scans the bitmap word by word
+ * from the id next to the last acquired one, and takes the first zero bit of the word.
+ * Even if almost all ids are in use, at most 1024 words are scanned, and no memory is allocated.<BR>
+ * The member functions without the _lock_free suffix are used when the caller serializes the calls by a lock.
+ * The member functions with the _lock_free suffix update the bitmap by atomic operations,
+ * and can be called from several threads concurrently. Don't mix both while the other is running.
+ */
+class packet_id_allocator {
+    static constexpr std::size_t const word_bits = 64;
+    static constexpr std::size_t const word_count = 0x10000 / word_bits;
+
+public:
+    packet_id_allocator() {
+        clear();
+    }
+
+    packet_id_allocator(packet_id_allocator const&) = delete;
+    packet_id_allocator& operator=(packet_id_allocator const&) = delete;
+
+    /**
+     * @brief Acquire an unused packet id.
+     * @return packet id
+     *
+     * If all packet ids are in use, packet_id_exhausted_error is thrown.
+     */
+    std::uint16_t acquire() {
+        return acquire_impl<false>();
+    }
+
+    /**
+     * @brief Register the packet id as in use.
+     * @param packet_id packet id
+     * @return true if registered, false if packet_id is 0 or already in use
+     */
+    bool reserve(std::uint16_t packet_id) {
+        if (packet_id == 0) return false;
+        auto& w = words_[packet_id / word_bits];
+        std::uint64_t bit = std::uint64_t(1) << (packet_id % word_bits);
+        std::uint64_t v = w.load(std::memory_order_relaxed);
+        if (v & bit) return false;
+        w.store(v | bit, std::memory_order_relaxed);
+        size_.store(size_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Release the packet id.
+     * @param packet_id packet id
+     * @return true if released, false if packet_id is not in use
+     */
+    bool release(std::uint16_t packet_id) {
+        if (packet_id == 0) return false;
+        auto& w = words_[packet_id / word_bits];
+        std::uint64_t bit = std::uint64_t(1) << (packet_id % word_bits);
+        std::uint64_t v = w.load(std::memory_order_relaxed);
+        if (!(v & bit)) return false;
+        w.store(v & ~bit, std::memory_order_relaxed);
+        size_.store(size_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Lock free version of acquire().
+     */
+    std::uint16_t acquire_lock_free() {
+        return acquire_impl<true>();
+    }
+
+    /**
+     * @brief Lock free version of reserve().
+     */
+    bool reserve_lock_free(std::uint16_t packet_id) {
+        if (packet_id == 0) return false;
+        std::uint64_t bit = std::uint64_t(1) << (packet_id % word_bits);
+        if (words_[packet_id / word_bits].fetch_or(bit, std::memory_order_acq_rel) & bit) return false;
+        size_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Lock free version of release().
+     */
+    bool release_lock_free(std::uint16_t packet_id) {
+        if (packet_id == 0) return false;
+        std::uint64_t bit = std::uint64_t(1) << (packet_id % word_bits);
+        if (!(words_[packet_id / word_bits].fetch_and(~bit, std::memory_order_acq_rel) & bit)) return false;
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Check whether the packet id is in use.
+     */
+    bool in_use(std::uint16_t packet_id) const {
+        if (packet_id == 0) return false;
+        std::uint64_t bit = std::uint64_t(1) << (packet_id % word_bits);
+        return words_[packet_id / word_bits].load(std::memory_order_acquire) & bit;
+    }
+
+    /**
+     * @brief Get the number of the packet ids in use.
+     */
+    std::size_t size() const {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Release all packet ids. It should not be called concurrently with the other functions.
+     */
+    void clear() {
+        // The packet id 0 is never acquired.
+        words_[0].store(1, std::memory_order_relaxed);
+        for (std::size_t i = 1; i != word_count; ++i) words_[i].store(0, std::memory_order_relaxed);
+        size_.store(0, std::memory_order_relaxed);
+        next_.store(1, std::memory_order_relaxed);
+    }
+
+private:
+    static std::size_t count_trailing_zeros(std::uint64_t v) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, v);
+        return index;
+#else  // defined(_MSC_VER)
+        return static_cast<std::size_t>(__builtin_ctzll(v));
+#endif // defined(_MSC_VER)
+    }
+
+    template <bool LockFree>
+    std::uint16_t acquire_impl() {
+        if (size_.load(std::memory_order_relaxed) >= 0xffff) throw packet_id_exhausted_error();
+        std::size_t start = next_.load(std::memory_order_relaxed);
+        std::size_t index = start / word_bits;
+        // The bits below start in the first word are scanned last, when the scan wraps around.
+        std::uint64_t mask = ~std::uint64_t(0) << (start % word_bits);
+        for (std::size_t n = 0; n <= word_count; ++n) {
+            auto& w = words_[index];
+            std::uint64_t v = w.load(std::memory_order_relaxed);
+            for (;;) {
+                std::uint64_t free = ~v & mask;
+                if (free == 0) break;
+                std::uint64_t bit = free & (~free + 1);
+                if (LockFree) {
+                    if (!w.compare_exchange_weak(
+                            v, v | bit, std::memory_order_acq_rel, std::memory_order_relaxed)) continue;
+                    size_.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    w.store(v | bit, std::memory_order_relaxed);
+                    size_.store(size_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                }
+                std::size_t id = index * word_bits + count_trailing_zeros(bit);
+                next_.store((id + 1) & 0xffff, std::memory_order_relaxed);
+                return static_cast<std::uint16_t>(id);
+            }
+            index = (index + 1) % word_count;
+            mask = ~std::uint64_t(0);
+        }
+        throw packet_id_exhausted_error();
+    }
+
+    std::atomic<std::uint64_t> words_[word_count];
+    std::atomic<std::size_t> size_;
+    // The packet id that the next scan starts from.
+    std::atomic<std::size_t> next_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_PACKET_ID_ALLOCATOR_HPP
@@ -0,0 +1,485 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_PACKET_PARSER_HPP)
+#define MQTT_PACKET_PARSER_HPP
+
+#include <string>
+#include <vector>
+#include <tuple>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+
+#include <boost/optional.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <mqtt/control_packet_type.hpp>
+#include <mqtt/connect_flags.hpp>
+#include <mqtt/session_present.hpp>
+#include <mqtt/publish.hpp>
+#include <mqtt/qos.hpp>
+#include <mqtt/will.hpp>
+#include <mqtt/exception.hpp>
+#include <mqtt/remaining_length.hpp>
+#include <mqtt/utf8encoded_strings.hpp>
+#include <mqtt/string_view.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Incremental MQTT packet parser.
+ *
+ * The parser doesn't do any I/O. Received bytes are given to parse(), and the decoded packets
+ * are notified to the visitor. The bytes of a truncated packet are not consumed,
+ * so the caller should keep them and give them again with the following bytes.<BR>
+ * The visitor should have the following member functions. If a member function returns false,
+ * parse() stops and returns immediately.
+ * @code
+ * bool on_connect(std::string client_id,
+ *                 boost::optional<std::string> user_name,
+ *                 boost::optional<std::string> password,
+ *                 boost::optional<will> w,
+ *                 bool clean_session,
+ *                 std::uint16_t keep_alive);
+ * bool on_connack(bool session_present, std::uint8_t return_code);
+ * bool on_publish(std::uint8_t fixed_header,
+ *                 boost::optional<std::uint16_t> packet_id,
+ *                 string_view topic_name,
+ *                 string_view contents);
+ * bool on_publish_begin(std::uint8_t fixed_header,
+ *                       boost::optional<std::uint16_t> packet_id,
+ *                       string_view topic_name,
+ *                       std::size_t contents_size);
+ * bool on_publish_chunk(string_view chunk, bool last);
+ * bool on_puback(std::uint16_t packet_id);
+ * bool on_pubrec(std::uint16_t packet_id);
+ * bool on_pubrel(std::uint16_t packet_id);
+ * bool on_pubcomp(std::uint16_t packet_id);
+ * bool on_subscribe(std::uint16_t packet_id, std::vector<std::tuple<std::string, std::uint8_t>> entries);
+ * bool on_suback(std::uint16_t packet_id, std::vector<boost::optional<std::uint8_t>> qoss);
+ * bool on_unsubscribe(std::uint16_t packet_id, std::vector<std::string> topics);
+ * bool on_unsuback(std::uint16_t packet_id);
+ * bool on_pingreq();
+ * bool on_pingresp();
+ * bool on_disconnect();
+ * @endcode
+ * string_view parameters refer to the given bytes. They are valid until the bytes are overwritten.
+ */
+class packet_parser {
+public:
+    enum class status {
+        need_more, ///< All complete packets are consumed. Give more bytes.
+        stopped,   ///< The visitor returned false.
+        error      ///< The packet is malformed.
+    };
+
+    struct result {
+        std::size_t consumed; ///< the number of consumed bytes
+        status st;
+        boost::system::error_code ec;
+    };
+
+    packet_parser()
+        :max_packet_size_(std::numeric_limits<std::size_t>::max()),
+         chunk_size_(0),
+         required_(0),
+         utf8_check_(true),
+         chunk_streaming_(false),
+         chunk_remaining_(0)
+    {}
+
+    /**
+     * @brief Set the maximum size of packets.
+     * @param size maximum packet size in bytes including the fixed header and the remaining length
+     *
+     * The size is checked just after the remaining length is decoded.
+     * When a packet exceeds the size, parse() returns status::error with errc::message_size.<BR>
+     * Streamed publish packets are not limited. The default is unlimited.
+     */
+    void set_max_packet_size(std::size_t size) {
+        max_packet_size_ = size;
+    }
+
+    std::size_t max_packet_size() const {
+        return max_packet_size_;
+    }
+
+    /**
+     * @brief Set the size of publish packets that are streamed by chunks.
+     * @param size If a publish packet is bigger than the size, its contents are notified
+     *             to on_publish_chunk() as they arrive instead of on_publish().
+     *             0 means no publish packets are streamed. The default is 0.
+     */
+    void set_chunk_size(std::size_t size) {
+        chunk_size_ = size;
+    }
+
+    /**
+     * @brief Set UTF-8 encoded string validation.
+     * @param b If true, the topic names, the topic filters, the client id, the will topic,
+     *          and the user name are validated. If a string is invalid, parse() returns status::error
+     *          with errc::illegal_byte_sequence. The default is true.
+     */
+    void set_utf8_check(bool b = true) {
+        utf8_check_ = b;
+    }
+
+    /**
+     * @brief Get the number of bytes required to decode the next packet.
+     * @return the size of the truncated packet at the top of the unconsumed bytes,
+     *         or 0 if its size is unknown yet.
+     */
+    std::size_t required() const {
+        return required_;
+    }
+
+    /**
+     * @brief Check whether a publish packet is being streamed.
+     * @return true if the contents of a publish packet are partially notified
+     */
+    bool streaming() const {
+        return chunk_streaming_;
+    }
+
+    /**
+     * @brief Clear the parsing state to parse a new byte stream.
+     */
+    void reset() {
+        required_ = 0;
+        chunk_streaming_ = false;
+        chunk_remaining_ = 0;
+    }
+
+    /**
+     * @brief Parse bytes
+     * @param data the top of the unconsumed bytes
+     * @param size the number of the unconsumed bytes
+     * @param v visitor that is notified of the decoded packets
+     * @return the number of consumed bytes and the status
+     */
+    template <typename Visitor>
+    result parse(char const* data, std::size_t size, Visitor& v) {
+        std::size_t consumed = 0;
+        required_ = 0;
+        while (true) {
+            char const* p = data + consumed;
+            std::size_t received = size - consumed;
+            if (chunk_streaming_) {
+                if (received == 0 && chunk_remaining_ != 0) break;
+                std::size_t chunk_size = std::min(received, chunk_remaining_);
+                consumed += chunk_size;
+                chunk_remaining_ -= chunk_size;
+                bool last = chunk_remaining_ == 0;
+                if (last) chunk_streaming_ = false;
+                if (!v.on_publish_chunk(string_view(p, chunk_size), last)) {
+                    return result{ consumed, status::stopped, boost::system::error_code() };
+                }
+                continue;
+            }
+            if (received < 2) break;
+
+            // Fixed header is followed by 1 to 4 bytes of the remaining length.
+            std::size_t remaining_length = 0;
+            boost::system::error_code ec;
+            std::size_t remaining_length_bytes = decode_remaining_length(p + 1, received - 1, remaining_length, ec);
+            if (ec) return error(consumed, boost::system::errc::protocol_error);
+            if (remaining_length_bytes == 0) break;
+            std::size_t i = 1 + remaining_length_bytes;
+
+            std::uint8_t fixed_header = static_cast<std::uint8_t>(p[0]);
+            std::size_t packet_size = i + remaining_length;
+            if (chunk_size_ != 0 &&
+                get_control_packet_type(fixed_header) == control_packet_type::publish &&
+                packet_size > chunk_size_) {
+                // Notify the contents by chunks as they arrive
+                // instead of storing the whole packet.
+                if (received < i + 2) {
+                    required_ = i + 2;
+                    break;
+                }
+                std::size_t topic_name_length = make_uint16_t(p[i], p[i + 1]);
+                std::size_t variable_header_size = 2 + topic_name_length;
+                boost::optional<std::uint16_t> packet_id;
+                if (publish::get_qos(fixed_header) != qos::at_most_once) {
+                    variable_header_size += 2;
+                }
+                if (remaining_length < variable_header_size) {
+                    return error(consumed, boost::system::errc::message_size);
+                }
+                if (received < i + variable_header_size) {
+                    required_ = i + variable_header_size;
+                    break;
+                }
+                string_view topic_name(p + i + 2, topic_name_length);
+                if (utf8_check_ && !utf8string::is_valid_contents(topic_name)) {
+                    return error(consumed, boost::system::errc::illegal_byte_sequence);
+                }
+                if (publish::get_qos(fixed_header) != qos::at_most_once) {
+                    packet_id = make_uint16_t(
+                        p[i + variable_header_size - 2],
+                        p[i + variable_header_size - 1]);
+                }
+                consumed += i + variable_header_size;
+                chunk_streaming_ = true;
+                chunk_remaining_ = remaining_length - variable_header_size;
+                if (!v.on_publish_begin(fixed_header, packet_id, topic_name, chunk_remaining_)) {
+                    return result{ consumed, status::stopped, boost::system::error_code() };
+                }
+                continue;
+            }
+            if (packet_size > max_packet_size_) {
+                return error(consumed, boost::system::errc::message_size);
+            }
+            if (received < packet_size) {
+                // Truncated packet.
+                required_ = packet_size;
+                break;
+            }
+            consumed += packet_size;
+            bool cont = handle_packet(fixed_header, p + i, remaining_length, v, ec);
+            if (ec) return result{ consumed, status::error, ec };
+            if (!cont) return result{ consumed, status::stopped, ec };
+        }
+        return result{ consumed, status::need_more, boost::system::error_code() };
+    }
+
+private:
+    static result error(std::size_t consumed, boost::system::errc::errc_t e) {
+        return result{ consumed, status::error, boost::system::errc::make_error_code(e) };
+    }
+
+    static bool fail(boost::system::error_code& ec, boost::system::errc::errc_t e) {
+        ec = boost::system::errc::make_error_code(e);
+        return false;
+    }
+
+    static std::uint16_t make_uint16_t(char b1, char b2) {
+        return
+            ((static_cast<std::uint16_t>(b1) & 0xff)) << 8 |
+            (static_cast<std::uint16_t>(b2) & 0xff);
+    }
+
+    // Read a length prefixed string at p[i], and advance i.
+    static bool read_string(
+        char const* p, std::size_t size, std::size_t& i, string_view& s) {
+        if (size < i + 2) return false;
+        std::uint16_t length = make_uint16_t(p[i], p[i + 1]);
+        i += 2;
+        if (size < i + length) return false;
+        s = string_view(p + i, length);
+        i += length;
+        return true;
+    }
+
+    // Read a length prefixed UTF-8 encoded string at p[i], and advance i.
+    bool read_utf8string(
+        char const* p, std::size_t size, std::size_t& i, string_view& s,
+        boost::system::error_code& ec) const {
+        if (!read_string(p, size, i, s)) return fail(ec, boost::system::errc::message_size);
+        if (utf8_check_ && !utf8string::is_valid_contents(s)) {
+            return fail(ec, boost::system::errc::illegal_byte_sequence);
+        }
+        return true;
+    }
+
+    template <typename Visitor>
+    bool handle_packet(
+        std::uint8_t fixed_header,
+        char const* p,
+        std::size_t size,
+        Visitor& v,
+        boost::system::error_code& ec) {
+        switch (get_control_packet_type(fixed_header)) {
+        case control_packet_type::connect:
+            return handle_connect(p, size, v, ec);
+        case control_packet_type::connack:
+            if (size != 2) return fail(ec, boost::system::errc::message_size);
+            return v.on_connack(is_session_present(p[0]), static_cast<std::uint8_t>(p[1]));
+        case control_packet_type::publish:
+            return handle_publish(fixed_header, p, size, v, ec);
+        case control_packet_type::puback:
+            if (size != 2) return fail(ec, boost::system::errc::message_size);
+            return v.on_puback(make_uint16_t(p[0], p[1]));
+        case control_packet_type::pubrec:
+            if (size != 2) return fail(ec, boost::system::errc::message_size);
+            return v.on_pubrec(make_uint16_t(p[0], p[1]));
+        case control_packet_type::pubrel:
+            if (size != 2) return fail(ec, boost::system::errc::message_size);
+            return v.on_pubrel(make_uint16_t(p[0], p[1]));
+        case control_packet_type::pubcomp:
+            if (size != 2) return fail(ec, boost::system::errc::message_size);
+            return v.on_pubcomp(make_uint16_t(p[0], p[1]));
+        case control_packet_type::subscribe:
+            return handle_subscribe(p, size, v, ec);
+        case control_packet_type::suback:
+            return handle_suback(p, size, v, ec);
+        case control_packet_type::unsubscribe:
+            return handle_unsubscribe(p, size, v, ec);
+        case control_packet_type::unsuback:
+            if (size != 2) return fail(ec, boost::system::errc::message_size);
+            return v.on_unsuback(make_uint16_t(p[0], p[1]));
+        case control_packet_type::pingreq:
+            if (size != 0) return fail(ec, boost::system::errc::message_size);
+            return v.on_pingreq();
+        case control_packet_type::pingresp:
+            if (size != 0) return fail(ec, boost::system::errc::message_size);
+            return v.on_pingresp();
+        case control_packet_type::disconnect:
+            if (size != 0) return fail(ec, boost::system::errc::message_size);
+            return v.on_disconnect();
+        default:
+            return fail(ec, boost::system::errc::protocol_error);
+        }
+    }
+
+    template <typename Visitor>
+    bool handle_connect(
+        char const* p,
+        std::size_t size,
+        Visitor& v,
+        boost::system::error_code& ec) {
+        std::size_t i = 0;
+        if (size < 10 ||
+            p[i++] != 0x00 ||
+            p[i++] != 0x04 ||
+            p[i++] != 'M' ||
+            p[i++] != 'Q' ||
+            p[i++] != 'T' ||
+            p[i++] != 'T' ||
+            p[i++] != 0x04) {
+            return fail(ec, boost::system::errc::protocol_error);
+        }
+        char byte8 = p[i++];
+
+        std::uint16_t keep_alive = make_uint16_t(p[i], p[i + 1]);
+        i += 2;
+
+        string_view client_id;
+        if (!read_utf8string(p, size, i, client_id, ec)) return false;
+
+        boost::optional<will> w;
+        if (connect_flags::has_will_flag(byte8)) {
+            string_view topic_name;
+            if (!read_utf8string(p, size, i, topic_name, ec)) return false;
+            string_view will_message;
+            if (!read_string(p, size, i, will_message)) return fail(ec, boost::system::errc::message_size);
+            w = will(topic_name.to_string(),
+                     will_message.to_string(),
+                     connect_flags::has_will_retain(byte8),
+                     connect_flags::will_qos(byte8));
+        }
+        boost::optional<std::string> user_name;
+        if (connect_flags::has_user_name_flag(byte8)) {
+            string_view s;
+            if (!read_utf8string(p, size, i, s, ec)) return false;
+            user_name = s.to_string();
+        }
+        boost::optional<std::string> password;
+        if (connect_flags::has_password_flag(byte8)) {
+            string_view s;
+            if (!read_string(p, size, i, s)) return fail(ec, boost::system::errc::message_size);
+            password = s.to_string();
+        }
+        return v.on_connect(
+            client_id.to_string(),
+            std::move(user_name),
+            std::move(password),
+            std::move(w),
+            connect_flags::has_clean_session(byte8),
+            keep_alive);
+    }
+
+    template <typename Visitor>
+    bool handle_publish(
+        std::uint8_t fixed_header,
+        char const* p,
+        std::size_t size,
+        Visitor& v,
+        boost::system::error_code& ec) {
+        std::size_t i = 0;
+        string_view topic_name;
+        if (!read_utf8string(p, size, i, topic_name, ec)) return false;
+        boost::optional<std::uint16_t> packet_id;
+        if (publish::get_qos(fixed_header) != qos::at_most_once) {
+            if (size < i + 2) return fail(ec, boost::system::errc::message_size);
+            packet_id = make_uint16_t(p[i], p[i + 1]);
+            i += 2;
+        }
+        return v.on_publish(fixed_header, packet_id, topic_name, string_view(p + i, size - i));
+    }
+
+    template <typename Visitor>
+    bool handle_subscribe(
+        char const* p,
+        std::size_t size,
+        Visitor& v,
+        boost::system::error_code& ec) {
+        if (size < 2) return fail(ec, boost::system::errc::message_size);
+        std::uint16_t packet_id = make_uint16_t(p[0], p[1]);
+        std::size_t i = 2;
+        std::vector<std::tuple<std::string, std::uint8_t>> entries;
+        while (i < size) {
+            string_view topic_filter;
+            if (!read_utf8string(p, size, i, topic_filter, ec)) return false;
+            if (size < i + 1) return fail(ec, boost::system::errc::message_size);
+            std::uint8_t qos = p[i++] & 0b00000011;
+            entries.emplace_back(topic_filter.to_string(), qos);
+        }
+        return v.on_subscribe(packet_id, std::move(entries));
+    }
+
+    template <typename Visitor>
+    static bool handle_suback(
+        char const* p,
+        std::size_t size,
+        Visitor& v,
+        boost::system::error_code& ec) {
+        if (size < 2) return fail(ec, boost::system::errc::message_size);
+        std::uint16_t packet_id = make_uint16_t(p[0], p[1]);
+        std::vector<boost::optional<std::uint8_t>> results;
+        results.reserve(size - 2);
+        for (std::size_t i = 2; i != size; ++i) {
+            if (p[i] & 0b10000000) {
+                results.push_back(boost::none);
+            }
+            else {
+                results.push_back(static_cast<std::uint8_t>(p[i]));
+            }
+        }
+        return v.on_suback(packet_id, std::move(results));
+    }
+
+    template <typename Visitor>
+    bool handle_unsubscribe(
+        char const* p,
+        std::size_t size,
+        Visitor& v,
+        boost::system::error_code& ec) {
+        if (size < 2) return fail(ec, boost::system::errc::message_size);
+        std::uint16_t packet_id = make_uint16_t(p[0], p[1]);
+        std::size_t i = 2;
+        std::vector<std::string> topic_filters;
+        while (i < size) {
+            string_view topic_filter;
+            if (!read_utf8string(p, size, i, topic_filter, ec)) return false;
+            topic_filters.emplace_back(topic_filter.to_string());
+        }
+        return v.on_unsubscribe(packet_id, std::move(topic_filters));
+    }
+
+private:
+    std::size_t max_packet_size_;
+    std::size_t chunk_size_;
+    std::size_t required_;
+    bool utf8_check_;
+    bool chunk_streaming_;
+    std::size_t chunk_remaining_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_PACKET_PARSER_HPP
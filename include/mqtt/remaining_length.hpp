@@ -8,10 +8,124 @@
 #define MQTT_REMAINING_LENGTH_HPP
 
 #include <string>
+#include <tuple>
+#include <cstdint>
+#include <boost/system/error_code.hpp>
 #include <mqtt/exception.hpp>
 
 namespace mqtt {
 
+/**
+ * @brief Get the number of bytes of the encoded remaining length.
+ * @param size remaining length
+ * @return 1 to 4
+ */
+constexpr std::size_t
+remaining_length_size(std::size_t size) {
+    return size < 0x80 ? 1 : size < 0x4000 ? 2 : size < 0x200000 ? 3 : 4;
+}
+
+/**
+ * @brief Encode the remaining length into the caller-provided bytes.
+ * @param size remaining length
+ * @param out destination that has at least remaining_length_size(size) bytes
+ * @return pointer past the last written byte
+ *
+ * If size is bigger than 268,435,455, remaining_length_error is thrown.
+ */
+constexpr char*
+encode_remaining_length(std::size_t size, char* out) {
+    if (size > 0xfffffff) throw remaining_length_error();
+    while (size > 127) {
+        *out++ = static_cast<char>((size & 0b01111111) | 0b10000000);
+        size >>= 7;
+    }
+    *out++ = static_cast<char>(size);
+    return out;
+}
+
+/**
+ * @brief Encoded remaining length that can be made at compile time.
+ */
+struct encoded_remaining_length {
+    char bytes[4];
+    std::size_t size;
+};
+
+constexpr encoded_remaining_length
+make_encoded_remaining_length(std::size_t size) {
+    encoded_remaining_length e { { 0, 0, 0, 0 }, remaining_length_size(size) };
+    encode_remaining_length(size, e.bytes);
+    return e;
+}
+
+/**
+ * @brief Decode the remaining length from the caller-provided bytes.
+ * @param p top of the remaining length
+ * @param size size of the available bytes
+ * @param length decoded remaining length
+ * @param ec set to errc::protocol_error if the remaining length is longer than 4 bytes
+ * @return number of the consumed bytes, or 0 if the bytes are not enough or ec is set
+ *
+ * If 4 bytes are available, the multi bytes remaining length is decoded at once without the loop.
+ */
+inline std::size_t
+decode_remaining_length(char const* p, std::size_t size, std::size_t& length, boost::system::error_code& ec) {
+    // Most packets are shorter than 128 bytes.
+    if (size != 0 && !(p[0] & 0b10000000)) {
+        length = static_cast<std::size_t>(p[0]);
+        return 1;
+    }
+    if (size >= 4) {
+        std::uint32_t v =
+            static_cast<std::uint32_t>(static_cast<std::uint8_t>(p[0])) |
+            static_cast<std::uint32_t>(static_cast<std::uint8_t>(p[1])) << 8 |
+            static_cast<std::uint32_t>(static_cast<std::uint8_t>(p[2])) << 16 |
+            static_cast<std::uint32_t>(static_cast<std::uint8_t>(p[3])) << 24;
+        // The MSBs of the bytes that don't have the continuation bit.
+        std::uint32_t ends = ~v & 0x80808080u;
+        if (ends == 0) {
+            ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+            return 0;
+        }
+        // The bytes up to the first end. It wraps around to 0xffffffff at the 4th byte.
+        std::uint32_t mask = ((ends & (~ends + 1)) << 1) - 1;
+        v &= mask & 0x7f7f7f7fu;
+        length =
+            (v & 0x7fu) |
+            (v >> 1 & 0x3f80u) |
+            (v >> 2 & 0x1fc000u) |
+            (v >> 3 & 0xfe00000u);
+        return 1 + (mask > 0xffu) + (mask > 0xffffu) + (mask > 0xffffffu);
+    }
+    std::size_t len = 0;
+    for (std::size_t i = 0; i != size; ++i) {
+        len |= (static_cast<std::size_t>(p[i]) & 0b01111111) << (7 * i);
+        if (!(p[i] & 0b10000000)) {
+            length = len;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Decode the remaining length from the caller-provided bytes.
+ * @param p top of the remaining length
+ * @param size size of the available bytes
+ * @param length decoded remaining length
+ * @return number of the consumed bytes, or 0 if the bytes are not enough
+ *
+ * If the remaining length is longer than 4 bytes, remaining_length_error is thrown.
+ */
+inline std::size_t
+decode_remaining_length(char const* p, std::size_t size, std::size_t& length) {
+    boost::system::error_code ec;
+    std::size_t consumed = decode_remaining_length(p, size, length, ec);
+    if (ec) throw remaining_length_error();
+    return consumed;
+}
+
 inline std::string
 remaining_bytes(std::size_t size) {
     if (size > 0xfffffff) throw remaining_length_error();
@@ -0,0 +1,295 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_SEND_BUFFER_POOL_HPP)
+#define MQTT_SEND_BUFFER_POOL_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+namespace mqtt {
+
+/**
+ * @brief Pool of send buffers classified by size.
+ *
+ * acquire() returns an empty string that has the capacity of the size class.
+ * The string goes back to the pool when the last reference is dropped.<BR>
+ * The memory blocks of the reference counts and the nodes of the containers that use
+ * send_buffer_pool::allocator are also recycled, so steady state sending doesn't allocate memory.<BR>
+ * Buffers can be released on any thread, even after the pool is destroyed.
+ */
+class send_buffer_pool {
+    struct impl;
+public:
+    static constexpr std::size_t const min_class_size = 64;
+    static constexpr std::size_t const max_class_size = 64 * 1024;
+
+    /**
+     * @brief Constructor
+     * @param max_pooled_bytes the maximum bytes of buffers and blocks kept in the pool
+     */
+    explicit send_buffer_pool(std::size_t max_pooled_bytes = 1024 * 1024)
+        :impl_(std::make_shared<impl>(max_pooled_bytes)) {}
+
+    /**
+     * @brief Allocator that recycles the memory blocks by the pool.
+     *
+     * It is used for the nodes of the async send queue.
+     */
+    template <typename T>
+    class allocator {
+    public:
+        using value_type = T;
+
+        explicit allocator(send_buffer_pool const& pool):impl_(pool.impl_) {}
+
+        template <typename U>
+        allocator(allocator<U> const& other):impl_(other.impl_) {}
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(impl_->allocate_block(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) {
+            impl_->deallocate_block(p, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(allocator<U> const& other) const {
+            return impl_ == other.impl_;
+        }
+
+        template <typename U>
+        bool operator!=(allocator<U> const& other) const {
+            return impl_ != other.impl_;
+        }
+
+    private:
+        template <typename U>
+        friend class allocator;
+
+        std::shared_ptr<impl> impl_;
+    };
+
+    /**
+     * @brief Acquire a buffer.
+     * @param size expected size of the buffer
+     * @return empty buffer that has at least the capacity of size
+     *
+     * If size is bigger than max_class_size, a dedicated buffer is allocated.
+     * It is freed instead of being pooled when it is released.
+     */
+    std::shared_ptr<std::string> acquire(std::size_t size) {
+        std::unique_ptr<std::string> buf;
+        {
+            std::lock_guard<std::mutex> lck (impl_->mtx);
+            std::size_t cls = class_index(size);
+            if (cls < num_classes && !impl_->pooled[cls].empty()) {
+                buf = std::move(impl_->pooled[cls].back());
+                impl_->pooled[cls].pop_back();
+                impl_->pooled_bytes -= buf->capacity();
+                ++impl_->hit;
+            }
+            else {
+                buf.reset(new std::string);
+                buf->reserve(cls < num_classes ? class_size(cls) : size);
+                ++impl_->miss;
+            }
+            impl_->outstanding_bytes += buf->capacity();
+        }
+        std::size_t capacity = buf->capacity();
+        return std::shared_ptr<std::string>(
+            buf.release(),
+            deleter { impl_, capacity },
+            allocator<std::string>(*this)
+        );
+    }
+
+    /**
+     * @brief Set the maximum bytes of buffers and blocks kept in the pool.
+     * @param bytes maximum bytes
+     */
+    void set_max_pooled_bytes(std::size_t bytes) {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        impl_->max_pooled_bytes = bytes;
+        impl_->shrink();
+    }
+
+    std::size_t max_pooled_bytes() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->max_pooled_bytes;
+    }
+
+    /**
+     * @brief Get the number of acquire() served by a pooled buffer.
+     */
+    std::size_t hit_count() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->hit;
+    }
+
+    /**
+     * @brief Get the number of acquire() that allocated a new buffer.
+     */
+    std::size_t miss_count() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->miss;
+    }
+
+    /**
+     * @brief Get the number of buffers currently kept in the pool.
+     */
+    std::size_t pooled_count() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        std::size_t count = 0;
+        for (auto const& p : impl_->pooled) count += p.size();
+        return count;
+    }
+
+    /**
+     * @brief Get the bytes of buffers and blocks currently kept in the pool.
+     */
+    std::size_t pooled_bytes() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->pooled_bytes;
+    }
+
+    /**
+     * @brief Get the capacity of the acquired buffers that are not released yet.
+     */
+    std::size_t outstanding_bytes() const {
+        std::lock_guard<std::mutex> lck (impl_->mtx);
+        return impl_->outstanding_bytes;
+    }
+
+private:
+    // 64, 128, ..., 64KiB
+    static constexpr std::size_t const num_classes = 11;
+
+    // Return the smallest class that holds size, or num_classes if size is too big.
+    static std::size_t class_index(std::size_t size) {
+        std::size_t cls = 0;
+        while (cls < num_classes && class_size(cls) < size) ++cls;
+        return cls;
+    }
+
+    static std::size_t class_size(std::size_t cls) {
+        return min_class_size << cls;
+    }
+
+    struct impl {
+        explicit impl(std::size_t max_pooled_bytes)
+            :max_pooled_bytes(max_pooled_bytes),
+             pooled_bytes(0),
+             outstanding_bytes(0),
+             hit(0),
+             miss(0) {}
+
+        ~impl() {
+            for (auto& b : blocks) {
+                for (auto p : b.second) ::operator delete(p);
+            }
+        }
+
+        void release(std::unique_ptr<std::string> buf, std::size_t acquired_capacity) {
+            std::lock_guard<std::mutex> lck (mtx);
+            outstanding_bytes -= acquired_capacity;
+            // The buffer could have grown, so it is classified by its current capacity.
+            std::size_t capacity = buf->capacity();
+            if (capacity < min_class_size || capacity > max_class_size) return;
+            if (pooled_bytes + capacity > max_pooled_bytes) return;
+            std::size_t cls = class_index(capacity);
+            if (class_size(cls) > capacity) --cls;
+            buf->clear();
+            pooled[cls].push_back(std::move(buf));
+            pooled_bytes += capacity;
+        }
+
+        void* allocate_block(std::size_t size) {
+            {
+                std::lock_guard<std::mutex> lck (mtx);
+                for (auto& b : blocks) {
+                    if (b.first == size && !b.second.empty()) {
+                        void* p = b.second.back();
+                        b.second.pop_back();
+                        pooled_bytes -= size;
+                        return p;
+                    }
+                }
+            }
+            return ::operator new(size);
+        }
+
+        void deallocate_block(void* p, std::size_t size) {
+            {
+                std::lock_guard<std::mutex> lck (mtx);
+                if (size <= max_class_size && pooled_bytes + size <= max_pooled_bytes) {
+                    auto it = std::find_if(
+                        blocks.begin(),
+                        blocks.end(),
+                        [size](std::pair<std::size_t, std::vector<void*>> const& b) {
+                            return b.first == size;
+                        }
+                    );
+                    if (it == blocks.end()) {
+                        blocks.emplace_back(size, std::vector<void*>());
+                        it = std::prev(blocks.end());
+                    }
+                    it->second.push_back(p);
+                    pooled_bytes += size;
+                    return;
+                }
+            }
+            ::operator delete(p);
+        }
+
+        // mtx should be locked
+        void shrink() {
+            for (auto& p : pooled) {
+                while (pooled_bytes > max_pooled_bytes && !p.empty()) {
+                    pooled_bytes -= p.back()->capacity();
+                    p.pop_back();
+                }
+            }
+            for (auto& b : blocks) {
+                while (pooled_bytes > max_pooled_bytes && !b.second.empty()) {
+                    ::operator delete(b.second.back());
+                    b.second.pop_back();
+                    pooled_bytes -= b.first;
+                }
+            }
+        }
+
+        mutable std::mutex mtx;
+        std::size_t max_pooled_bytes;
+        std::size_t pooled_bytes;
+        std::size_t outstanding_bytes;
+        std::size_t hit;
+        std::size_t miss;
+        std::vector<std::unique_ptr<std::string>> pooled[num_classes];
+        // Free blocks by size.
+        std::vector<std::pair<std::size_t, std::vector<void*>>> blocks;
+    };
+
+    struct deleter {
+        void operator()(std::string* p) const {
+            impl_->release(std::unique_ptr<std::string>(p), capacity);
+        }
+        std::shared_ptr<impl> impl_;
+        std::size_t capacity;
+    };
+
+    std::shared_ptr<impl> impl_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_SEND_BUFFER_POOL_HPP
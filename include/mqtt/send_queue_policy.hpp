@@ -0,0 +1,37 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_SEND_QUEUE_POLICY_HPP)
+#define MQTT_SEND_QUEUE_POLICY_HPP
+
+namespace mqtt {
+
+/**
+ * @brief Policy of the async publish while the async send queue is over the high watermark.
+ */
+enum class send_queue_policy {
+    /**
+     * @brief The publish is not queued.
+     * The handler is called with boost::system::errc::no_buffer_space.
+     */
+    reject,
+    /**
+     * @brief The publish is queued, and the oldest QoS0 publish that is not being written is dropped.
+     * The handler of the dropped publish is called with boost::system::errc::operation_canceled.
+     */
+    drop_oldest_qos0,
+    /**
+     * @brief The publish function blocks until the queue falls to the low watermark.
+     * The function must not be called on the thread that runs the io_service.
+     * If it is called in the strand of the endpoint, or the endpoint has no strand,
+     * the publish is rejected as send_queue_policy::reject instead of blocking.
+     */
+    block,
+};
+
+} // namespace mqtt
+
+#endif // MQTT_SEND_QUEUE_POLICY_HPP
@@ -0,0 +1,70 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_SESSION_STORE_HPP)
+#define MQTT_SESSION_STORE_HPP
+
+#include <cstdint>
+#include <string>
+#include <functional>
+
+#include <mqtt/string_view.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Interface of the persistent store of the QoS1 and QoS2 packets in flight.
+ *
+ * The endpoint keeps the packets in flight in memory, and also passes them to the session store
+ * if it is set by endpoint::set_session_store(). When the endpoint is created again, for example
+ * after the process is restarted, the packets are recovered from the session store, and resent
+ * on CONNACK of the session that is not clean.<BR>
+ * The member functions are called while the endpoint locks the stored packets.
+ * If the endpoint is shared by several threads, they are called from those threads.
+ */
+class session_store {
+public:
+    using for_each_handler = std::function<
+        void(std::uint16_t packet_id, std::uint8_t expected_control_packet_type, std::string packet)>;
+
+    virtual ~session_store() = default;
+
+    /**
+     * @brief Store the packet.
+     * @param packet_id packet id
+     * @param expected_control_packet_type the control packet type that completes the packet
+     * @param header the bytes from the fixed header to the variable header
+     * @param payload the payload
+     *
+     * If the packet that has packet_id is stored, it is replaced.
+     */
+    virtual void add(
+        std::uint16_t packet_id,
+        std::uint8_t expected_control_packet_type,
+        string_view header,
+        string_view payload) = 0;
+
+    /**
+     * @brief Remove the packet.
+     * @param packet_id packet id
+     */
+    virtual void remove(std::uint16_t packet_id) = 0;
+
+    /**
+     * @brief Remove all packets.
+     */
+    virtual void clear() = 0;
+
+    /**
+     * @brief Call f for each stored packet in the order of storing.
+     * @param f handler
+     */
+    virtual void for_each(for_each_handler const& f) = 0;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_SESSION_STORE_HPP
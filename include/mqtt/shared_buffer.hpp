@@ -0,0 +1,62 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_SHARED_BUFFER_HPP)
+#define MQTT_SHARED_BUFFER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <mqtt/string_view.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Reference counted slice of a buffer.
+ *
+ * The slice keeps the underlying buffer alive. Copying the slice doesn't copy the bytes,
+ * so it can be passed to another thread as is.
+ */
+class shared_buffer {
+public:
+    shared_buffer()
+        :data_(nullptr),
+         size_(0) {}
+
+    shared_buffer(
+        std::shared_ptr<std::vector<char> const> owner,
+        char const* data,
+        std::size_t size)
+        :owner_(std::move(owner)),
+         data_(data),
+         size_(size) {}
+
+    char const* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    char const* begin() const { return data_; }
+    char const* end() const { return data_ + size_; }
+    char operator[](std::size_t i) const { return data_[i]; }
+
+    string_view view() const { return string_view(data_, size_); }
+    std::string to_string() const { return std::string(data_, size_); }
+
+    /**
+     * @brief Get the underlying buffer.
+     * @return the buffer that contains the slice
+     */
+    std::shared_ptr<std::vector<char> const> const& owner() const { return owner_; }
+
+private:
+    std::shared_ptr<std::vector<char> const> owner_;
+    char const* data_;
+    std::size_t size_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_SHARED_BUFFER_HPP
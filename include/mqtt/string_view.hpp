@@ -0,0 +1,20 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_STRING_VIEW_HPP)
+#define MQTT_STRING_VIEW_HPP
+
+#include <boost/utility/string_ref.hpp>
+
+namespace mqtt {
+
+// Non owning reference to a character sequence.
+// Call to_string() to get an owning copy.
+using string_view = boost::string_ref;
+
+} // namespace mqtt
+
+#endif // MQTT_STRING_VIEW_HPP
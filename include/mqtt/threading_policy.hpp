@@ -0,0 +1,62 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_THREADING_POLICY_HPP)
+#define MQTT_THREADING_POLICY_HPP
+
+#include <mutex>
+
+#include <boost/asio.hpp>
+
+#include <mqtt/null_strand.hpp>
+#include <mqtt/null_mutex.hpp>
+
+namespace mqtt {
+
+namespace as = boost::asio;
+
+/**
+ * @brief The client runs on one thread. No strand and no locks.
+ *
+ * The io_service should be run by one thread, and all member functions of the client
+ * should be called on that thread.
+ */
+struct single_threaded {
+    using strand = null_strand;
+    using mutex = null_mutex;
+    template <typename... Mutex>
+    using lock_guard = std::lock_guard<Mutex...>;
+};
+
+/**
+ * @brief The client is serialized by the strand. No locks for the stored packets.
+ *
+ * The io_service can be run by several threads. All member functions of the client
+ * should be called in the handlers of the client, or in the functions posted to the strand.
+ */
+struct strand_serialized {
+    using strand = as::io_service::strand;
+    using mutex = null_mutex;
+    template <typename... Mutex>
+    using lock_guard = std::lock_guard<Mutex...>;
+};
+
+/**
+ * @brief The client is used by several threads. The strand and the locks for the stored packets.
+ *
+ * The io_service can be run by several threads, and the member functions of the client
+ * can be called on any thread.
+ */
+struct multi_threaded {
+    using strand = as::io_service::strand;
+    using mutex = std::mutex;
+    template <typename... Mutex>
+    using lock_guard = std::lock_guard<Mutex...>;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_THREADING_POLICY_HPP
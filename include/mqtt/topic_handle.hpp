@@ -0,0 +1,103 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TOPIC_HANDLE_HPP)
+#define MQTT_TOPIC_HANDLE_HPP
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include <mqtt/string_view.hpp>
+#include <mqtt/encoded_length.hpp>
+#include <mqtt/utf8encoded_strings.hpp>
+#include <mqtt/exception.hpp>
+
+namespace mqtt {
+
+/**
+ * @brief Topic name that is validated and encoded once.
+ *
+ * When the same topic is published repeatedly, pass the handle to the publish APIs
+ * instead of the string. The topic name is not validated and encoded on each publish,
+ * and the encoded bytes are appended to the packet as is.<BR>
+ * The handle is cheap to copy, and can be shared by several endpoints and threads.
+ */
+class topic_handle {
+public:
+    /**
+     * @brief Constructor
+     * @param name topic name
+     * @param utf8_check if true, the contents of name is validated as an UTF-8 encoded string.
+     *
+     * If name is too long, utf8string_length_error is thrown.<BR>
+     * If utf8_check is true and name is invalid, utf8string_contents_error is thrown.
+     */
+    explicit topic_handle(std::string const& name, bool utf8_check = true)
+        :encoded_(encode(name, utf8_check)) {}
+
+    /**
+     * @brief Get the topic name.
+     */
+    string_view name() const {
+        return string_view(encoded_->data() + 2, encoded_->size() - 2);
+    }
+
+    /**
+     * @brief Get the encoded bytes, the 2 bytes length followed by the topic name.
+     */
+    string_view encoded() const {
+        return string_view(*encoded_);
+    }
+
+private:
+    static std::shared_ptr<std::string const> encode(std::string const& name, bool utf8_check) {
+        if (!utf8string::is_valid_length(name)) throw utf8string_length_error();
+        if (utf8_check && !utf8string::is_valid_contents(name)) throw utf8string_contents_error();
+        auto encoded = std::make_shared<std::string>(2, '\0');
+        encode_length(static_cast<std::uint16_t>(name.size()), &(*encoded)[0]);
+        encoded->append(name);
+        return encoded;
+    }
+
+    std::shared_ptr<std::string const> encoded_;
+};
+
+/**
+ * @brief Topic name of the publish APIs.
+ *
+ * It is implicitly constructed from std::string const&, char const*, and topic_handle.
+ * The string is validated and encoded on each publish.
+ * The topic_handle is appended as is.
+ */
+class topic_view {
+public:
+    topic_view(std::string const& name)
+        :name_(name) {}
+
+    topic_view(char const* name)
+        :name_(name) {}
+
+    topic_view(topic_handle const& handle)
+        :name_(handle.name()),
+         encoded_(handle.encoded()) {}
+
+    string_view name() const { return name_; }
+
+    /**
+     * @brief Get the encoded bytes.
+     * @return the encoded bytes if it is constructed from topic_handle, otherwise empty.
+     */
+    string_view encoded() const { return encoded_; }
+
+private:
+    string_view name_;
+    string_view encoded_;
+};
+
+} // namespace mqtt
+
+#endif // MQTT_TOPIC_HANDLE_HPP
@@ -0,0 +1,32 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TRY_PUBLISH_STATUS_HPP)
+#define MQTT_TRY_PUBLISH_STATUS_HPP
+
+namespace mqtt {
+
+/**
+ * @brief Result of the try publish APIs.
+ */
+enum class try_publish_status {
+    /**
+     * @brief The publish is queued to the async send queue.
+     */
+    queued,
+    /**
+     * @brief The publish is dropped because the async send queue is high or the memory budget is exhausted.
+     */
+    queue_full,
+    /**
+     * @brief The publish is dropped because the endpoint is not connected.
+     */
+    not_connected,
+};
+
+} // namespace mqtt
+
+#endif // MQTT_TRY_PUBLISH_STATUS_HPP
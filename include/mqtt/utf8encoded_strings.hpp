@@ -8,23 +8,249 @@
 #define MQTT_UTF8ENCODED_STRINGS_HPP
 
 #include <string>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MQTT_UTF8_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <mqtt/string_view.hpp>
 
 namespace mqtt {
 
 namespace utf8string {
 
 inline bool
-is_valid_length(std::string const& str) {
+is_valid_length(string_view str) {
     return str.size() <= 0xffff;
 }
 
 inline bool
-is_valid_contents(std::string const& /*str*/) {
-    // not implemented yet
-    // See 1.5.3 UTF-8 encoded strings
+is_valid_length(std::string const& str) {
+    return is_valid_length(string_view(str));
+}
+
+enum class validation {
+    /**
+     * @brief UTF-8 string is well formed.
+     * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718016<BR>
+     * 1.5.3 UTF-8 encoded strings
+     */
+    well_formed,
+    /**
+     * @brief UTF-8 string is well formed but contains control characters or non-characters.
+     * The receiver MAY close the connection.<BR>
+     * U+0001..U+001F control characters<BR>
+     * U+007F..U+009F control characters<BR>
+     * Code points defined in the Unicode specification to be non-characters (for example U+0FFFF)
+     */
+    well_formed_with_non_character,
+    /**
+     * @brief UTF-8 string is ill formed or contains U+0000.
+     */
+    ill_formed,
+};
+
+namespace detail {
+
+// Validate the character at the top of p.
+// Return the size of the character in bytes, or 0 if it is ill formed.
+inline std::size_t
+validate_char(unsigned char const* p, std::size_t size, bool& non_char) {
+    unsigned char c = p[0];
+    if (c < 0x80) {
+        if (c == 0x00) return 0;
+        if (c < 0x20 || c == 0x7f) non_char = true;
+        return 1;
+    }
+    if (c < 0xc2) return 0; // continuation byte or overlong encoding
+    if (c < 0xe0) {
+        if (size < 2 || (p[1] & 0xc0) != 0x80) return 0;
+        std::uint32_t cp = (c & 0x1fu) << 6 | (p[1] & 0x3fu);
+        if (cp <= 0x9f) non_char = true;
+        return 2;
+    }
+    if (c < 0xf0) {
+        if (size < 3) return 0;
+        unsigned char lower = c == 0xe0 ? 0xa0 : 0x80; // overlong encoding
+        unsigned char upper = c == 0xed ? 0x9f : 0xbf; // surrogates
+        if (p[1] < lower || p[1] > upper || (p[2] & 0xc0) != 0x80) return 0;
+        std::uint32_t cp = (c & 0x0fu) << 12 | (p[1] & 0x3fu) << 6 | (p[2] & 0x3fu);
+        if ((cp >= 0xfdd0 && cp <= 0xfdef) || (cp & 0xfffe) == 0xfffe) non_char = true;
+        return 3;
+    }
+    if (c < 0xf5) {
+        if (size < 4) return 0;
+        unsigned char lower = c == 0xf0 ? 0x90 : 0x80; // overlong encoding
+        unsigned char upper = c == 0xf4 ? 0x8f : 0xbf; // over U+10FFFF
+        if (p[1] < lower || p[1] > upper ||
+            (p[2] & 0xc0) != 0x80 ||
+            (p[3] & 0xc0) != 0x80) return 0;
+        std::uint32_t cp =
+            (c & 0x07u) << 18 | (p[1] & 0x3fu) << 12 | (p[2] & 0x3fu) << 6 | (p[3] & 0x3fu);
+        if ((cp & 0xfffe) == 0xfffe) non_char = true;
+        return 4;
+    }
+    return 0;
+}
+
+// Check whether all 8 bytes are in U+0020..U+007E.
+inline bool
+is_printable_ascii8(unsigned char const* p) {
+    constexpr std::uint64_t const ones = 0x0101010101010101ull;
+    constexpr std::uint64_t const highs = 0x8080808080808080ull;
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    std::uint64_t less_than_0x20 = (v - ones * 0x20) & ~v;
+    std::uint64_t x = v ^ (ones * 0x7f);
+    std::uint64_t equal_to_0x7f = (x - ones) & ~x;
+    return ((v | less_than_0x20 | equal_to_0x7f) & highs) == 0;
+}
+
+inline validation
+validate_scalar(unsigned char const* p, std::size_t size, bool non_char = false) {
+    std::size_t i = 0;
+    while (i < size) {
+        if (i + 8 <= size && is_printable_ascii8(p + i)) {
+            i += 8;
+            continue;
+        }
+        std::size_t n = validate_char(p + i, size - i, non_char);
+        if (n == 0) return validation::ill_formed;
+        i += n;
+    }
+    return non_char ? validation::well_formed_with_non_character : validation::well_formed;
+}
+
+// Validate the character at p[i] and the following non ASCII characters, and advance i.
+inline bool
+validate_non_ascii(unsigned char const* p, std::size_t size, std::size_t& i, bool& non_char) {
+    do {
+        std::size_t n = validate_char(p + i, size - i, non_char);
+        if (n == 0) return false;
+        i += n;
+    } while (i < size && p[i] >= 0x80);
     return true;
 }
 
+inline std::size_t
+count_trailing_zeros(std::uint32_t v) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return index;
+#else  // defined(_MSC_VER)
+    return static_cast<std::size_t>(__builtin_ctz(v));
+#endif // defined(_MSC_VER)
+}
+
+#if defined(__AVX2__)
+
+// Return the bit mask of the bytes that are not in U+0020..U+007E.
+inline std::uint32_t
+non_printable_ascii_mask32(unsigned char const* p) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+    // Bytes over 0x7f are negative, so they are less than 0x20 as signed values.
+    __m256i lt = _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), v);
+    __m256i del = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f));
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(lt, del)));
+}
+
+#endif // defined(__AVX2__)
+
+#if defined(MQTT_UTF8_SSE2)
+
+// Return the bit mask of the bytes that are not in U+0020..U+007E.
+inline std::uint32_t
+non_printable_ascii_mask16(unsigned char const* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    // Bytes over 0x7f are negative, so they are less than 0x20 as signed values.
+    __m128i lt = _mm_cmplt_epi8(v, _mm_set1_epi8(0x20));
+    __m128i del = _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_or_si128(lt, del)));
+}
+
+#endif // defined(MQTT_UTF8_SSE2)
+
+inline validation
+validate(unsigned char const* p, std::size_t size) {
+    if (size < 16) return validate_scalar(p, size);
+    bool non_char = false;
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    while (i + 32 <= size) {
+        std::uint32_t mask = non_printable_ascii_mask32(p + i);
+        if (mask == 0) {
+            i += 32;
+            continue;
+        }
+        // Skip the printable ASCII characters, and then validate the following
+        // non ASCII characters one by one.
+        i += count_trailing_zeros(mask);
+        if (!validate_non_ascii(p, size, i, non_char)) return validation::ill_formed;
+    }
+#endif // defined(__AVX2__)
+#if defined(MQTT_UTF8_SSE2)
+    while (i + 16 <= size) {
+        std::uint32_t mask = non_printable_ascii_mask16(p + i);
+        if (mask == 0) {
+            i += 16;
+            continue;
+        }
+        i += count_trailing_zeros(mask);
+        if (!validate_non_ascii(p, size, i, non_char)) return validation::ill_formed;
+    }
+    // The rest is shorter than 16 bytes.
+    // If the last 16 bytes are printable ASCII characters, the rest is valid.
+    if (i != size && non_printable_ascii_mask16(p + size - 16) == 0) {
+        i = size;
+    }
+#endif // defined(MQTT_UTF8_SSE2)
+    return validate_scalar(p + i, size - i, non_char);
+}
+
+} // namespace detail
+
+/**
+ * @brief Validate UTF-8 encoded string.
+ * @param str UTF-8 encoded string
+ * @return validation result
+ *
+ * ASCII characters are checked by SSE2 or AVX2 instructions if they are enabled on compile.
+ */
+inline validation
+validate_contents(string_view str) {
+    return detail::validate(reinterpret_cast<unsigned char const*>(str.data()), str.size());
+}
+
+/**
+ * @brief Check whether the string is a valid UTF-8 encoded string on MQTT.
+ * @param str UTF-8 encoded string
+ * @return false if the string is ill formed or contains U+0000, otherwise true.
+ *
+ * See http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html#_Toc398718016<BR>
+ * 1.5.3 UTF-8 encoded strings
+ */
+inline bool
+is_valid_contents(string_view str) {
+    return validate_contents(str) != validation::ill_formed;
+}
+
+inline bool
+is_valid_contents(std::string const& str) {
+    return is_valid_contents(string_view(str));
+}
+
 } // namespace utf8string
 
 } // namespace mqtt
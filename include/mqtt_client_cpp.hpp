@@ -5,19 +5,35 @@
 // http://www.boost.org/LICENSE_1_0.txt)
 
 
+#include <mqtt/buffer_pool.hpp>
 #include <mqtt/client.hpp>
 #include <mqtt/connect_flags.hpp>
 #include <mqtt/connect_return_code.hpp>
+#include <mqtt/contents_buffer.hpp>
 #include <mqtt/control_packet_type.hpp>
 #include <mqtt/encoded_length.hpp>
 #include <mqtt/exception.hpp>
 #include <mqtt/fixed_header.hpp>
+#include <mqtt/flat_store.hpp>
 #include <mqtt/hexdump.hpp>
+#include <mqtt/log_session_store.hpp>
+#include <mqtt/null_atomic.hpp>
+#include <mqtt/null_mutex.hpp>
+#include <mqtt/packet_id_allocator.hpp>
+#include <mqtt/packet_parser.hpp>
 #include <mqtt/publish.hpp>
 #include <mqtt/qos.hpp>
 #include <mqtt/remaining_length.hpp>
+#include <mqtt/send_buffer_pool.hpp>
+#include <mqtt/send_queue_policy.hpp>
 #include <mqtt/session_present.hpp>
+#include <mqtt/session_store.hpp>
+#include <mqtt/shared_buffer.hpp>
 #include <mqtt/str_connect_return_code.hpp>
 #include <mqtt/str_qos.hpp>
+#include <mqtt/string_view.hpp>
+#include <mqtt/threading_policy.hpp>
+#include <mqtt/topic_handle.hpp>
+#include <mqtt/try_publish_status.hpp>
 #include <mqtt/utf8encoded_strings.hpp>
 #include <mqtt/will.hpp>
@@ -1000,5 +1000,439 @@ BOOST_AUTO_TEST_CASE( publish_function ) {
     BOOST_TEST(order++ == 5);
 }
 
+BOOST_AUTO_TEST_CASE( pub_qos0_burst_coalesced ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_write_coalescing(16, 1024);
+
+    int const count = 100;
+    int sent = 0;
+    int received = 0;
+
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->async_subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c, &sent]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            // Queued in a row, so they are written by a few async_write() calls.
+            for (int i = 0; i != count; ++i) {
+                c->async_publish_at_most_once(
+                    topic_base() + "/topic1",
+                    "contents" + std::to_string(i),
+                    false,
+                    [&sent, i]
+                    (boost::system::error_code const& ec) {
+                        BOOST_TEST(!ec);
+                        BOOST_TEST(sent++ == i);
+                    });
+            }
+            return true;
+        });
+    c->set_publish_handler(
+        [&c, &received]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            BOOST_TEST(contents == "contents" + std::to_string(received));
+            if (++received == count) c->async_disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(sent == count);
+    BOOST_TEST(received == count);
+}
+
+BOOST_AUTO_TEST_CASE( pub_qos1_shared_contents ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+
+    // The same contents is published twice without copying.
+    auto contents = std::make_shared<std::string const>("shared contents");
+    int acked = 0;
+    int received = 0;
+
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->async_subscribe(topic_base() + "/topic1", mqtt::qos::at_least_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c, &contents]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            c->async_publish_at_least_once(topic_base() + "/topic1", contents);
+            c->async_publish_at_least_once(topic_base() + "/topic1", contents);
+            return true;
+        });
+    c->set_puback_handler(
+        [&c, &acked, &received]
+        (std::uint16_t) {
+            if (++acked == 2 && received == 2) c->async_disconnect();
+            return true;
+        });
+    c->set_publish_handler(
+        [&c, &acked, &received]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            BOOST_TEST(contents == "shared contents");
+            if (++received == 2 && acked == 2) c->async_disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(acked == 2);
+    BOOST_TEST(received == 2);
+    // The acknowledged packets don't hold the contents any more.
+    BOOST_TEST(contents.use_count() == 1);
+}
+
+BOOST_AUTO_TEST_CASE( pub_qos0_send_queue_drop ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    // The queue is high while a packet is queued.
+    c->set_send_queue_watermarks(
+        std::numeric_limits<std::size_t>::max(),
+        std::numeric_limits<std::size_t>::max(),
+        1,
+        0);
+    c->set_send_queue_policy(mqtt::send_queue_policy::drop_oldest_qos0);
+
+    int const count = 10;
+    int sent = 0;
+    int dropped = 0;
+    int received = 0;
+    int high = 0;
+    int low = 0;
+
+    c->set_send_queue_high_handler(
+        [&high]
+        () {
+            ++high;
+        });
+    c->set_send_queue_low_handler(
+        [&low]
+        () {
+            ++low;
+        });
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->async_subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c, &sent, &dropped]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            // The first one is being written, and the others are dropped.
+            for (int i = 0; i != count; ++i) {
+                c->async_publish_at_most_once(
+                    topic_base() + "/topic1",
+                    "contents" + std::to_string(i),
+                    false,
+                    [&sent, &dropped]
+                    (boost::system::error_code const& ec) {
+                        if (ec == boost::system::errc::operation_canceled) ++dropped;
+                        else if (!ec) ++sent;
+                    });
+            }
+            return true;
+        });
+    c->set_publish_handler(
+        [&c, &received]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            BOOST_TEST(contents == "contents0");
+            ++received;
+            c->async_disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(sent == 1);
+    BOOST_TEST(dropped == count - 1);
+    BOOST_TEST(received == 1);
+    BOOST_TEST(high >= 1);
+    BOOST_TEST(low >= 1);
+    BOOST_TEST(c->queued_bytes() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( try_pub_qos0 ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    // The queue is high while a packet is queued.
+    c->set_send_queue_watermarks(
+        std::numeric_limits<std::size_t>::max(),
+        std::numeric_limits<std::size_t>::max(),
+        1,
+        0);
+
+    BOOST_CHECK(
+        c->try_async_publish_at_most_once(topic_base() + "/topic1", "contents") ==
+        mqtt::try_publish_status::not_connected);
+
+    std::vector<mqtt::try_publish_status> results;
+    int received = 0;
+
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->async_subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c, &ios, &results]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            results.push_back(c->try_async_publish_at_most_once(topic_base() + "/topic1", "contents1"));
+            // The first publish is queued before this.
+            ios.post(
+                [&c, &results]
+                () {
+                    results.push_back(c->try_async_publish_at_most_once(topic_base() + "/topic1", "contents2"));
+                });
+            return true;
+        });
+    c->set_publish_handler(
+        [&c, &received]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            BOOST_TEST(contents == "contents1");
+            ++received;
+            c->async_disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(received == 1);
+    BOOST_TEST(results.size() == 2U);
+    BOOST_CHECK(results[0] == mqtt::try_publish_status::queued);
+    BOOST_CHECK(results[1] == mqtt::try_publish_status::queue_full);
+}
+
+BOOST_AUTO_TEST_CASE( pingreq_with_backlog ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+
+    int const count = 50;
+    std::string const contents(256 * 1024, 'a');
+    int received = 0;
+    int received_at_pingresp = -1;
+
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->async_subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c, &contents]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            for (int i = 0; i != count; ++i) {
+                c->async_publish_at_most_once(topic_base() + "/topic1", contents);
+            }
+            // Queued after the backlog, but written at the next packet boundary.
+            c->async_pingreq();
+            return true;
+        });
+    c->set_pingresp_handler(
+        [&received, &received_at_pingresp]
+        () {
+            received_at_pingresp = received;
+            return true;
+        });
+    c->set_publish_handler(
+        [&c, &received]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string) {
+            if (++received == count) c->async_disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(received == count);
+    BOOST_TEST(received_at_pingresp >= 0);
+    BOOST_TEST(received_at_pingresp < count / 2);
+}
+
+BOOST_AUTO_TEST_CASE( pub_qos0_linger ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_write_linger(boost::posix_time::microseconds(200), 1024);
+
+    int const count = 100;
+    int sent = 0;
+    int received = 0;
+
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->async_subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c, &sent]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            // The first one waits for the following ones up to 200us or 1024 bytes.
+            for (int i = 0; i != count; ++i) {
+                c->async_publish_at_most_once(
+                    topic_base() + "/topic1",
+                    "contents" + std::to_string(i),
+                    false,
+                    [&sent, i]
+                    (boost::system::error_code const& ec) {
+                        BOOST_TEST(!ec);
+                        BOOST_TEST(sent++ == i);
+                    });
+            }
+            return true;
+        });
+    c->set_publish_handler(
+        [&c, &received]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            BOOST_TEST(contents == "contents" + std::to_string(received));
+            if (++received == count) c->async_disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(sent == count);
+    BOOST_TEST(received == count);
+}
+
+
+BOOST_AUTO_TEST_CASE( pub_qos1_inflight_window ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_max_inflight(2);
+
+    int const count = 10;
+    int received = 0;
+    int acked = 0;
+    int room = 0;
+
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->async_subscribe(topic_base() + "/topic1", mqtt::qos::at_least_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            for (int i = 0; i != count; ++i) {
+                c->async_publish_at_least_once(topic_base() + "/topic1", "contents" + std::to_string(i));
+            }
+            // The publishes beyond the window are queued.
+            BOOST_TEST(c->inflight_count() == 2U);
+            return true;
+        });
+    c->set_puback_handler(
+        [&c, &acked, &received]
+        (std::uint16_t) {
+            BOOST_TEST(c->inflight_count() <= 2U);
+            if (++acked == count && received == count) c->async_disconnect();
+            return true;
+        });
+    c->set_inflight_room_handler(
+        [&room]
+        () {
+            ++room;
+        });
+    c->set_publish_handler(
+        [&c, &received, &acked]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            BOOST_TEST(contents == "contents" + std::to_string(received));
+            if (++received == count && acked == count) c->async_disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(received == count);
+    BOOST_TEST(acked == count);
+    BOOST_TEST(room == 1);
+    BOOST_TEST(c->inflight_count() == 0U);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,59 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <mqtt/buffer_pool.hpp>
+#include <mqtt/shared_buffer.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_buffer_pool)
+
+BOOST_AUTO_TEST_CASE( recycle ) {
+    mqtt::buffer_pool pool(128);
+    auto b1 = pool.acquire(100);
+    BOOST_TEST(b1->size() == 128U);
+    BOOST_TEST(pool.miss_count() == 1U);
+    BOOST_TEST(pool.pooled_count() == 0U);
+    auto p1 = b1.get();
+    b1.reset();
+    BOOST_TEST(pool.pooled_count() == 1U);
+    auto b2 = pool.acquire(128);
+    BOOST_TEST(b2.get() == p1);
+    BOOST_TEST(pool.hit_count() == 1U);
+    BOOST_TEST(pool.miss_count() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( oversize ) {
+    mqtt::buffer_pool pool(128);
+    auto b1 = pool.acquire(129);
+    BOOST_TEST(b1->size() == 129U);
+    b1.reset();
+    BOOST_TEST(pool.pooled_count() == 0U);
+    BOOST_TEST(pool.miss_count() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( max_pooled ) {
+    mqtt::buffer_pool pool(16, 1);
+    auto b1 = pool.acquire(16);
+    auto b2 = pool.acquire(16);
+    b1.reset();
+    b2.reset();
+    BOOST_TEST(pool.pooled_count() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( slice_outlives_pool ) {
+    mqtt::shared_buffer sb;
+    {
+        mqtt::buffer_pool pool(16);
+        auto b = pool.acquire(16);
+        std::copy_n("0123456789abcdef", 16, b->data());
+        sb = mqtt::shared_buffer(b, b->data() + 4, 6);
+    }
+    BOOST_TEST(sb.to_string() == "456789");
+    BOOST_TEST(sb.view() == "456789");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include <mqtt/flat_store.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_flat_store)
+
+namespace {
+
+std::vector<std::string> values(mqtt::flat_store<std::string> const& s) {
+    return std::vector<std::string>(s.begin(), s.end());
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( emplace_find ) {
+    mqtt::flat_store<std::string> s;
+    BOOST_TEST(s.empty());
+    BOOST_TEST(!s.find(1));
+
+    auto r1 = s.emplace(1, "a");
+    BOOST_TEST(r1.second);
+    BOOST_TEST(*r1.first == "a");
+    auto r2 = s.emplace(0xffff, "b");
+    BOOST_TEST(r2.second);
+
+    // The existing value is kept.
+    auto r3 = s.emplace(1, "c");
+    BOOST_TEST(!r3.second);
+    BOOST_TEST(*r3.first == "a");
+
+    BOOST_TEST(s.size() == 2U);
+    BOOST_TEST(*s.find(1) == "a");
+    BOOST_TEST(*s.find(0xffff) == "b");
+    BOOST_TEST(!s.find(2));
+}
+
+BOOST_AUTO_TEST_CASE( order ) {
+    mqtt::flat_store<std::string> s;
+    s.emplace(3, "a");
+    s.emplace(1, "b");
+    s.emplace(2, "c");
+    BOOST_TEST((values(s) == std::vector<std::string>{ "a", "b", "c" }));
+
+    BOOST_TEST(s.erase(1));
+    BOOST_TEST(!s.erase(1));
+    BOOST_TEST((values(s) == std::vector<std::string>{ "a", "c" }));
+
+    // The erased slot is reused, and the value is linked at the end.
+    s.emplace(1, "d");
+    BOOST_TEST((values(s) == std::vector<std::string>{ "a", "c", "d" }));
+
+    auto it = s.begin();
+    it = s.erase(it);
+    BOOST_TEST(*it == "c");
+    BOOST_TEST((values(s) == std::vector<std::string>{ "c", "d" }));
+    BOOST_TEST(!s.find(3));
+}
+
+BOOST_AUTO_TEST_CASE( clear ) {
+    mqtt::flat_store<std::string> s;
+    for (std::uint16_t i = 1; i != 0; ++i) s.emplace(i, "v");
+    BOOST_TEST(s.size() == 0xffffU);
+    s.clear();
+    BOOST_TEST(s.empty());
+    BOOST_TEST(!s.find(1));
+    BOOST_TEST((s.begin() == s.end()));
+    s.emplace(2, "a");
+    BOOST_TEST((values(s) == std::vector<std::string>{ "a" }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <memory>
+#include <cerrno>
+
+#include <mqtt/session_store.hpp>
+#include <mqtt/exception.hpp>
+
+#include "loopback_endpoint.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_inflight)
+
+namespace {
+
+struct failing_session_store : mqtt::session_store {
+    void add(std::uint16_t, std::uint8_t, mqtt::string_view, mqtt::string_view) override {
+        if (failing) throw mqtt::session_store_error("write", "failing_session_store", EIO);
+    }
+    void remove(std::uint16_t) override {}
+    void clear() override {}
+    void for_each(for_each_handler const&) override {}
+    bool failing = true;
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( clean_session_keeps_waiting_publish_counted ) {
+    loopback_endpoint c;
+    c.ep->set_clean_session(true);
+    c.ep->set_max_inflight(1);
+    bool connacked = false;
+    c.ep->set_connack_handler(
+        [&](bool, std::uint8_t) {
+            connacked = true;
+            return true;
+        }
+    );
+    std::uint16_t acked = 0;
+    c.ep->set_puback_handler(
+        [&](std::uint16_t packet_id) {
+            acked = packet_id;
+            return true;
+        }
+    );
+    c.ep->start_session();
+    auto base = c.ep->memory_usage();
+
+    // Each publish is 13 bytes. The second one waits for the in-flight window.
+    c.ep->publish_at_least_once("topic1", "a");
+    auto pid2 = c.ep->publish_at_least_once("topic1", "b");
+    BOOST_TEST(c.ep->memory_usage() == base + 26);
+
+    // Reconnected with a clean session. The stored publish is cleared,
+    // and the waiting publish is sent and stored.
+    c.write_peer(std::string("\x20\x02\x00\x00", 4), [&] { return connacked; });
+    BOOST_TEST(c.ep->memory_usage() == base + 13);
+
+    c.write_peer(
+        std::string("\x40\x02", 2) + static_cast<char>(pid2 >> 8) + static_cast<char>(pid2 & 0xff),
+        [&] { return acked == pid2; });
+    BOOST_TEST(c.ep->memory_usage() == base);
+}
+
+BOOST_AUTO_TEST_CASE( session_store_fails_before_sending ) {
+    loopback_endpoint c;
+    auto store = std::make_shared<failing_session_store>();
+    c.ep->set_session_store(store);
+    c.ep->set_max_inflight(1);
+    auto base = c.ep->memory_usage();
+
+    // The publishes are not sent, and release their packet ids and in-flight slots.
+    BOOST_CHECK_THROW(c.ep->publish_at_least_once("topic1", "a"), mqtt::session_store_error);
+    BOOST_CHECK_THROW(c.ep->async_publish_at_least_once("topic1", "b"), mqtt::session_store_error);
+    BOOST_TEST(c.ep->memory_usage() == base);
+
+    store->failing = false;
+    auto pid = c.ep->publish_at_least_once("topic1", "c");
+    BOOST_TEST(c.ep->memory_usage() == base + 13);
+    std::string bytes(13, '\0');
+    as::read(c.peer, as::buffer(&bytes[0], bytes.size()));
+    BOOST_TEST(
+        bytes ==
+        std::string("\x32\x0b\x00\x06topic1", 10) +
+        static_cast<char>(pid >> 8) + static_cast<char>(pid & 0xff) + "c");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
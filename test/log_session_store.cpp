@@ -0,0 +1,217 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <tuple>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else  // defined(_WIN32)
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // defined(_WIN32)
+
+#include <mqtt/log_session_store.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_log_session_store)
+
+namespace {
+
+using record = std::tuple<std::uint16_t, std::uint8_t, std::string>;
+
+std::string const path = "log_session_store_test.log";
+
+std::vector<record> records(mqtt::session_store& s) {
+    std::vector<record> ret;
+    s.for_each(
+        [&]
+        (std::uint16_t packet_id, std::uint8_t expected_control_packet_type, std::string packet) {
+            ret.emplace_back(packet_id, expected_control_packet_type, std::move(packet));
+        }
+    );
+    return ret;
+}
+
+long file_length() {
+    std::FILE* fp = std::fopen(path.c_str(), "rb");
+    std::fseek(fp, 0, SEEK_END);
+    long size = std::ftell(fp);
+    std::fclose(fp);
+    return size;
+}
+
+void make_directory(std::string const& p) {
+#if defined(_WIN32)
+    _mkdir(p.c_str());
+#else  // defined(_WIN32)
+    ::mkdir(p.c_str(), 0755);
+#endif // defined(_WIN32)
+}
+
+void remove_directory(std::string const& p) {
+#if defined(_WIN32)
+    _rmdir(p.c_str());
+#else  // defined(_WIN32)
+    ::rmdir(p.c_str());
+#endif // defined(_WIN32)
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( recover ) {
+    std::remove(path.c_str());
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        s.add(1, 4, "h1", "p1");
+        s.add(2, 5, "h2", "p2");
+        s.add(3, 4, "h3", "");
+        s.remove(2);
+        // Replaced
+        s.add(1, 7, "h1'", "");
+        s.remove(4);
+        BOOST_TEST(s.size() == 2U);
+    }
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        BOOST_TEST(s.size() == 2U);
+        BOOST_TEST((records(s) == std::vector<record> { record(3, 4, "h3"), record(1, 7, "h1'") }));
+        s.clear();
+        s.add(5, 4, "h5", "p5");
+    }
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        BOOST_TEST((records(s) == std::vector<record> { record(5, 4, "h5p5") }));
+    }
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( batched ) {
+    std::remove(path.c_str());
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::batched, 3, std::chrono::hours(1));
+        // Each record is written at once, and only the fsync is batched.
+        s.add(1, 4, "h1", "");
+        BOOST_TEST(file_length() == static_cast<long>(s.file_size()));
+        s.add(2, 4, "h2", "");
+        s.add(3, 4, "h3", "");
+        s.add(4, 4, "h4", "");
+        BOOST_TEST(file_length() == static_cast<long>(s.file_size()));
+        s.commit();
+        s.add(5, 4, "h5", "");
+    }
+    {
+        mqtt::log_session_store s(path);
+        BOOST_TEST(s.size() == 5U);
+    }
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( compact ) {
+    std::remove(path.c_str());
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        s.set_compaction(1024, 2);
+        std::string const payload(100, 'x');
+        for (std::uint16_t i = 1; i <= 100; ++i) {
+            s.add(i, 4, "h", payload);
+            if (i > 2) s.remove(static_cast<std::uint16_t>(i - 2));
+            // The file doesn't grow over the threshold.
+            BOOST_TEST(s.file_size() <= 2048U);
+        }
+        BOOST_TEST(s.size() == 2U);
+        s.compact();
+        BOOST_TEST(s.file_size() == static_cast<std::uint64_t>(file_length()));
+        BOOST_TEST(s.file_size() == 8U + 2 * (8 + 101 + 4));
+        BOOST_TEST((records(s) == std::vector<record> { record(99, 4, "h" + payload), record(100, 4, "h" + payload) }));
+        s.add(101, 4, "h101", "");
+    }
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        BOOST_TEST(s.size() == 3U);
+    }
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( add_fails_by_compaction ) {
+    std::remove(path.c_str());
+    std::string const tmp_path = path + ".tmp";
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        s.set_compaction(0, 0);
+        s.add(1, 4, "h1", "");
+        s.remove(1);
+        s.add(2, 4, "h2", "");
+        // The compacted file can't be created.
+        make_directory(tmp_path);
+        s.set_compaction(0, 1);
+        auto size = s.file_size();
+        BOOST_CHECK_THROW(s.add(3, 4, "h3", ""), mqtt::session_store_error);
+        // Replaced by the failed add.
+        BOOST_CHECK_THROW(s.add(2, 5, "h2'", ""), mqtt::session_store_error);
+        // The failed adds leave no live record.
+        BOOST_TEST(s.size() == 1U);
+        BOOST_TEST(s.file_size() == size);
+        BOOST_TEST(file_length() == static_cast<long>(size));
+        BOOST_TEST((records(s) == std::vector<record> { record(2, 4, "h2") }));
+        remove_directory(tmp_path);
+        // The log is kept, and it is compacted by the next add.
+        s.add(3, 4, "h3", "");
+        BOOST_TEST(s.file_size() == 8U + 2 * (8 + 2 + 4));
+    }
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        BOOST_TEST((records(s) == std::vector<record> { record(2, 4, "h2"), record(3, 4, "h3") }));
+    }
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( torn_record ) {
+    std::remove(path.c_str());
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        s.add(1, 4, "h1", "p1");
+        s.add(2, 4, "h2", "p2");
+    }
+    long size = file_length();
+    {
+        // Corrupt the last byte of the CRC of the last record, and append a partial record.
+        std::FILE* fp = std::fopen(path.c_str(), "r+b");
+        std::fseek(fp, size - 1, SEEK_SET);
+        int c = std::fgetc(fp);
+        std::fseek(fp, size - 1, SEEK_SET);
+        std::fputc(c ^ 0xff, fp);
+        std::fseek(fp, 0, SEEK_END);
+        std::fwrite("A\x00", 1, 2, fp);
+        std::fclose(fp);
+    }
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        BOOST_TEST((records(s) == std::vector<record> { record(1, 4, "h1p1") }));
+        BOOST_TEST(file_length() == 8 + 8 + 4 + 4);
+        s.add(3, 4, "h3", "");
+    }
+    {
+        mqtt::log_session_store s(path, mqtt::fsync_policy::never);
+        BOOST_TEST((records(s) == std::vector<record> { record(1, 4, "h1p1"), record(3, 4, "h3") }));
+    }
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( invalid_file ) {
+    {
+        std::FILE* fp = std::fopen(path.c_str(), "wb");
+        std::fputs("not a log file", fp);
+        std::fclose(fp);
+    }
+    BOOST_CHECK_THROW(mqtt::log_session_store s(path), mqtt::session_store_error);
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
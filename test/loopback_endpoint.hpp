@@ -0,0 +1,79 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#if !defined(MQTT_TEST_LOOPBACK_ENDPOINT_HPP)
+#define MQTT_TEST_LOOPBACK_ENDPOINT_HPP
+
+#include <string>
+#include <thread>
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+#include <mqtt/endpoint.hpp>
+#include <mqtt/null_strand.hpp>
+#include <mqtt/null_mutex.hpp>
+
+namespace as = boost::asio;
+
+using loopback_endpoint_t = mqtt::endpoint<as::ip::tcp::socket, mqtt::null_strand, mqtt::null_mutex>;
+
+// The endpoint that is connected to the peer socket on the loopback.
+// The peer plays the broker without a broker.
+struct loopback_endpoint {
+    loopback_endpoint()
+        :acceptor(ios, as::ip::tcp::endpoint(as::ip::address::from_string("127.0.0.1"), 0)),
+         peer(ios),
+         ep(std::make_shared<loopback_endpoint_t>(ios)) {
+        ep->socket().reset(new as::ip::tcp::socket(ios));
+        ep->socket()->connect(acceptor.local_endpoint());
+        acceptor.accept(peer);
+        ep->set_connect();
+    }
+
+    // Write to the socket until its send buffer is full,
+    // so that the following async writes wait for the peer.
+    // Returns the written bytes.
+    std::size_t fill_socket() {
+        auto& s = *ep->socket();
+        s.non_blocking(true);
+        std::string const bytes(4096, '\0');
+        std::size_t written = 0;
+        for (;;) {
+            boost::system::error_code ec;
+            written += s.write_some(as::buffer(bytes), ec);
+            if (ec == as::error::would_block) return written;
+            BOOST_REQUIRE(!ec);
+        }
+    }
+
+    // Run the io_service while the peer reads the bytes.
+    std::string read_peer(std::size_t size) {
+        std::string bytes(size, '\0');
+        std::thread th(
+            [&] {
+                as::read(peer, as::buffer(&bytes[0], bytes.size()));
+            }
+        );
+        ios.run();
+        th.join();
+        return bytes;
+    }
+
+    // Write the bytes from the peer, and run the io_service until done() returns true.
+    template <typename F>
+    void write_peer(std::string const& bytes, F const& done) {
+        as::write(peer, as::buffer(bytes));
+        while (!done()) ios.run_one();
+    }
+
+    as::io_service ios;
+    as::ip::tcp::acceptor acceptor;
+    as::ip::tcp::socket peer;
+    std::shared_ptr<loopback_endpoint_t> ep;
+};
+
+#endif // MQTT_TEST_LOOPBACK_ENDPOINT_HPP
@@ -0,0 +1,85 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <mqtt/packet_id_allocator.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_packet_id_allocator)
+
+BOOST_AUTO_TEST_CASE( acquire_release ) {
+    mqtt::packet_id_allocator a;
+    BOOST_TEST(a.acquire() == 1);
+    BOOST_TEST(a.acquire() == 2);
+    BOOST_TEST(a.release(1));
+    BOOST_TEST(!a.release(1));
+    BOOST_TEST(!a.release(0));
+    // The scan continues from the id next to the last acquired one.
+    BOOST_TEST(a.acquire() == 3);
+    BOOST_TEST(a.size() == 2U);
+
+    BOOST_TEST(!a.reserve(0));
+    BOOST_TEST(!a.reserve(2));
+    BOOST_TEST(a.reserve(4));
+    BOOST_TEST(a.acquire() == 5);
+    BOOST_TEST(a.in_use(4));
+    BOOST_TEST(!a.in_use(1));
+}
+
+BOOST_AUTO_TEST_CASE( exhausted ) {
+    mqtt::packet_id_allocator a;
+    for (std::size_t i = 0; i != 0xffff; ++i) a.acquire();
+    BOOST_TEST(a.size() == 0xffffU);
+    BOOST_CHECK_THROW(a.acquire(), mqtt::packet_id_exhausted_error);
+
+    // The only unused id is found after wrapping around.
+    BOOST_TEST(a.release(100));
+    BOOST_TEST(a.acquire() == 100);
+    BOOST_TEST(a.release(0xffff));
+    BOOST_TEST(a.acquire_lock_free() == 0xffff);
+
+    a.clear();
+    BOOST_TEST(a.size() == 0U);
+    BOOST_TEST(a.acquire() == 1);
+}
+
+BOOST_AUTO_TEST_CASE( lock_free ) {
+    mqtt::packet_id_allocator a;
+    std::size_t const threads = 4;
+    std::size_t const per_thread = 10000;
+    std::vector<std::vector<std::uint16_t>> ids(threads);
+    std::atomic<std::size_t> release_failed(0);
+    std::vector<std::thread> ths;
+    for (std::size_t t = 0; t != threads; ++t) {
+        ths.emplace_back(
+            [&, t] {
+                for (std::size_t i = 0; i != per_thread; ++i) {
+                    auto id = a.acquire_lock_free();
+                    // Release a half of them to make the others reuse them.
+                    if (i % 2) {
+                        if (!a.release_lock_free(id)) ++release_failed;
+                    }
+                    else ids[t].push_back(id);
+                }
+            }
+        );
+    }
+    for (auto& th : ths) th.join();
+    BOOST_TEST(release_failed == 0U);
+
+    std::set<std::uint16_t> all;
+    for (auto const& v : ids) all.insert(v.begin(), v.end());
+    BOOST_TEST(all.size() == threads * per_thread / 2);
+    BOOST_TEST(a.size() == all.size());
+    for (auto id : all) BOOST_TEST(a.in_use(id));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,288 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <mqtt/packet_parser.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_packet_parser)
+
+namespace {
+
+// Records the decoded packets as strings.
+struct recorder {
+    bool on_connect(
+        std::string client_id,
+        boost::optional<std::string> user_name,
+        boost::optional<std::string> password,
+        boost::optional<mqtt::will> w,
+        bool clean_session,
+        std::uint16_t keep_alive) {
+        std::string s = "connect " + client_id;
+        if (user_name) s += " u:" + *user_name;
+        if (password) s += " p:" + *password;
+        if (w) s += " w:" + w->topic() + "=" + w->message();
+        s += clean_session ? " clean" : "";
+        s += " " + std::to_string(keep_alive);
+        events.push_back(s);
+        return true;
+    }
+    bool on_connack(bool session_present, std::uint8_t return_code) {
+        events.push_back("connack " + std::to_string(session_present) + " " + std::to_string(return_code));
+        return true;
+    }
+    bool on_publish(
+        std::uint8_t fixed_header,
+        boost::optional<std::uint16_t> packet_id,
+        mqtt::string_view topic_name,
+        mqtt::string_view contents) {
+        events.push_back(
+            "publish " + std::to_string(mqtt::publish::get_qos(fixed_header)) +
+            " " + (packet_id ? std::to_string(*packet_id) : std::string("-")) +
+            " " + topic_name.to_string() + "=" + contents.to_string());
+        return publish_result;
+    }
+    bool on_publish_begin(
+        std::uint8_t,
+        boost::optional<std::uint16_t> packet_id,
+        mqtt::string_view topic_name,
+        std::size_t contents_size) {
+        events.push_back(
+            "begin " + (packet_id ? std::to_string(*packet_id) : std::string("-")) +
+            " " + topic_name.to_string() + " " + std::to_string(contents_size));
+        return true;
+    }
+    bool on_publish_chunk(mqtt::string_view chunk, bool last) {
+        events.push_back("chunk " + chunk.to_string() + (last ? " last" : ""));
+        return true;
+    }
+    bool on_puback(std::uint16_t packet_id) {
+        events.push_back("puback " + std::to_string(packet_id));
+        return true;
+    }
+    bool on_pubrec(std::uint16_t packet_id) {
+        events.push_back("pubrec " + std::to_string(packet_id));
+        return true;
+    }
+    bool on_pubrel(std::uint16_t packet_id) {
+        events.push_back("pubrel " + std::to_string(packet_id));
+        return true;
+    }
+    bool on_pubcomp(std::uint16_t packet_id) {
+        events.push_back("pubcomp " + std::to_string(packet_id));
+        return true;
+    }
+    bool on_subscribe(std::uint16_t packet_id, std::vector<std::tuple<std::string, std::uint8_t>> entries) {
+        std::string s = "subscribe " + std::to_string(packet_id);
+        for (auto const& e : entries) s += " " + std::get<0>(e) + ":" + std::to_string(std::get<1>(e));
+        events.push_back(s);
+        return true;
+    }
+    bool on_suback(std::uint16_t packet_id, std::vector<boost::optional<std::uint8_t>> qoss) {
+        std::string s = "suback " + std::to_string(packet_id);
+        for (auto const& q : qoss) s += " " + (q ? std::to_string(*q) : std::string("x"));
+        events.push_back(s);
+        return true;
+    }
+    bool on_unsubscribe(std::uint16_t packet_id, std::vector<std::string> topics) {
+        std::string s = "unsubscribe " + std::to_string(packet_id);
+        for (auto const& t : topics) s += " " + t;
+        events.push_back(s);
+        return true;
+    }
+    bool on_unsuback(std::uint16_t packet_id) {
+        events.push_back("unsuback " + std::to_string(packet_id));
+        return true;
+    }
+    bool on_pingreq() {
+        events.push_back("pingreq");
+        return true;
+    }
+    bool on_pingresp() {
+        events.push_back("pingresp");
+        return true;
+    }
+    bool on_disconnect() {
+        events.push_back("disconnect");
+        return true;
+    }
+
+    std::vector<std::string> events;
+    bool publish_result = true;
+};
+
+// Feeds bytes one by one, keeping the unconsumed bytes like a receive buffer.
+mqtt::packet_parser::result feed_bytewise(
+    mqtt::packet_parser& parser, std::string const& bytes, recorder& r) {
+    std::string buf;
+    mqtt::packet_parser::result ret { 0, mqtt::packet_parser::status::need_more, boost::system::error_code() };
+    for (char c : bytes) {
+        buf.push_back(c);
+        ret = parser.parse(buf.data(), buf.size(), r);
+        buf.erase(0, ret.consumed);
+        if (ret.st != mqtt::packet_parser::status::need_more) break;
+    }
+    return ret;
+}
+
+std::string const packets(
+    // CONNECT client_id "cid", will "wt"="wm", user "u", password "p", clean session, keep alive 60
+    "\x10\x1d\x00\x04MQTT\x04\xe6\x00\x3c"
+    "\x00\x03" "cid" "\x00\x02" "wt" "\x00\x02" "wm" "\x00\x01" "u" "\x00\x01" "p"
+    // CONNACK session present, accepted
+    "\x20\x02\x01\x00"
+    // PUBLISH QoS1 packet_id 1 "t"="hello"
+    "\x32\x0a\x00\x01t\x00\x01hello"
+    // PUBLISH QoS0 "t"="" (empty contents)
+    "\x30\x03\x00\x01t"
+    // PUBACK 1, PUBREC 2, PUBREL 2, PUBCOMP 2
+    "\x40\x02\x00\x01" "\x50\x02\x00\x02" "\x62\x02\x00\x02" "\x70\x02\x00\x02"
+    // SUBSCRIBE packet_id 3 "a":1 "b":2
+    "\x82\x0a\x00\x03\x00\x01" "a" "\x01\x00\x01" "b" "\x02"
+    // SUBACK packet_id 3 1 failure
+    "\x90\x04\x00\x03\x01\x80"
+    // UNSUBSCRIBE packet_id 4 "a"
+    "\xa2\x05\x00\x04\x00\x01" "a"
+    // UNSUBACK 4, PINGREQ, PINGRESP, DISCONNECT
+    "\xb0\x02\x00\x04" "\xc0\x00" "\xd0\x00" "\xe0\x00",
+    103);
+
+std::vector<std::string> const expected {
+    "connect cid u:u p:p w:wt=wm clean 60",
+    "connack 1 0",
+    "publish 1 1 t=hello",
+    "publish 0 - t=",
+    "puback 1",
+    "pubrec 2",
+    "pubrel 2",
+    "pubcomp 2",
+    "subscribe 3 a:1 b:2",
+    "suback 3 1 x",
+    "unsubscribe 4 a",
+    "unsuback 4",
+    "pingreq",
+    "pingresp",
+    "disconnect"
+};
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( all_packets ) {
+    mqtt::packet_parser parser;
+    recorder r;
+    auto ret = parser.parse(packets.data(), packets.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::need_more);
+    BOOST_TEST(ret.consumed == packets.size());
+    BOOST_TEST(r.events == expected);
+}
+
+BOOST_AUTO_TEST_CASE( bytewise ) {
+    mqtt::packet_parser parser;
+    recorder r;
+    auto ret = feed_bytewise(parser, packets, r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::need_more);
+    BOOST_TEST(r.events == expected);
+}
+
+BOOST_AUTO_TEST_CASE( required ) {
+    mqtt::packet_parser parser;
+    recorder r;
+    std::string bytes("\x32\x0a\x00\x01t", 5);
+    auto ret = parser.parse(bytes.data(), 1, r);
+    BOOST_TEST(ret.consumed == 0U);
+    BOOST_TEST(parser.required() == 0U);
+    ret = parser.parse(bytes.data(), bytes.size(), r);
+    BOOST_TEST(ret.consumed == 0U);
+    BOOST_TEST(parser.required() == 12U);
+    BOOST_TEST(r.events.empty());
+}
+
+BOOST_AUTO_TEST_CASE( stopped ) {
+    mqtt::packet_parser parser;
+    recorder r;
+    r.publish_result = false;
+    auto ret = parser.parse(packets.data(), packets.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::stopped);
+    BOOST_TEST(ret.consumed == 31U + 4U + 12U);
+    BOOST_TEST(r.events.size() == 3U);
+}
+
+BOOST_AUTO_TEST_CASE( malformed ) {
+    mqtt::packet_parser parser;
+    recorder r;
+    std::string bytes("\x40\x03\x00\x01\x00", 5);
+    auto ret = parser.parse(bytes.data(), bytes.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::error);
+    BOOST_CHECK(ret.ec == boost::system::errc::message_size);
+    BOOST_TEST(r.events.empty());
+
+    std::string reserved("\x00\x00", 2);
+    ret = parser.parse(reserved.data(), reserved.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::error);
+    BOOST_CHECK(ret.ec == boost::system::errc::protocol_error);
+}
+
+BOOST_AUTO_TEST_CASE( utf8_check ) {
+    mqtt::packet_parser parser;
+    recorder r;
+    // PUBLISH QoS0 topic "\xff"
+    std::string bytes("\x30\x04\x00\x01\xff" "a", 6);
+    auto ret = parser.parse(bytes.data(), bytes.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::error);
+    BOOST_CHECK(ret.ec == boost::system::errc::illegal_byte_sequence);
+    BOOST_TEST(r.events.empty());
+
+    parser.set_utf8_check(false);
+    ret = parser.parse(bytes.data(), bytes.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::need_more);
+    BOOST_TEST(r.events.size() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( max_packet_size ) {
+    mqtt::packet_parser parser;
+    parser.set_max_packet_size(11);
+    recorder r;
+    // Only the fixed header and the remaining length are required to detect the error.
+    std::string bytes("\x32\x0a", 2);
+    auto ret = parser.parse(bytes.data(), bytes.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::error);
+    BOOST_CHECK(ret.ec == boost::system::errc::message_size);
+}
+
+BOOST_AUTO_TEST_CASE( remaining_length_overflow ) {
+    mqtt::packet_parser parser;
+    recorder r;
+    std::string bytes("\x30\xff\xff\xff\xff\x01", 6);
+    auto ret = parser.parse(bytes.data(), bytes.size(), r);
+    BOOST_CHECK(ret.st == mqtt::packet_parser::status::error);
+    BOOST_CHECK(ret.ec == boost::system::errc::protocol_error);
+    BOOST_TEST(ret.consumed == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( chunk ) {
+    mqtt::packet_parser parser;
+    parser.set_chunk_size(8);
+    recorder r;
+    // PUBLISH QoS1 packet_id 1 "t"="hello", followed by PINGREQ
+    std::string bytes("\x32\x0a\x00\x01t\x00\x01hello\xc0\x00", 14);
+    std::string buf;
+    for (std::size_t i = 0; i < bytes.size(); i += 3) {
+        buf.append(bytes, i, 3);
+        auto ret = parser.parse(buf.data(), buf.size(), r);
+        BOOST_CHECK(ret.st == mqtt::packet_parser::status::need_more);
+        buf.erase(0, ret.consumed);
+    }
+    BOOST_TEST(!parser.streaming());
+    std::vector<std::string> expected {
+        "begin 1 t 5",
+        "chunk he",
+        "chunk llo last",
+        "pingreq"
+    };
+    BOOST_TEST(r.events == expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1001,4 +1001,150 @@ BOOST_AUTO_TEST_CASE( publish_function ) {
 }
 
 
+BOOST_AUTO_TEST_CASE( publish_view_handler ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+
+    std::uint16_t pid_sub;
+    std::uint16_t pid_unsub;
+
+    int order = 0;
+    c->set_connack_handler(
+        [&order, &c, &pid_sub]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(order++ == 0);
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            pid_sub = c->subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_close_handler(
+        [&order]
+        () {
+            BOOST_TEST(order++ == 4);
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_puback_handler(
+        []
+        (std::uint16_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_pubrec_handler(
+        []
+        (std::uint16_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_pubcomp_handler(
+        []
+        (std::uint16_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_suback_handler(
+        [&order, &c, &pid_sub]
+        (std::uint16_t packet_id, std::vector<boost::optional<std::uint8_t>> results) {
+            BOOST_TEST(order++ == 1);
+            BOOST_TEST(packet_id == pid_sub);
+            BOOST_TEST(results.size() == 1U);
+            BOOST_TEST(*results[0] == mqtt::qos::at_most_once);
+            c->publish_at_most_once(topic_base() + "/topic1", "topic1_contents");
+            return true;
+        });
+    c->set_unsuback_handler(
+        [&order, &c, &pid_unsub]
+        (std::uint16_t packet_id) {
+            BOOST_TEST(order++ == 3);
+            BOOST_TEST(packet_id == pid_unsub);
+            c->disconnect();
+            return true;
+        });
+    c->set_publish_handler(
+        []
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_publish_view_handler(
+        [&order, &c, &pid_unsub]
+        (std::uint8_t header,
+         boost::optional<std::uint16_t> packet_id,
+         mqtt::string_view topic,
+         mqtt::string_view contents) {
+            BOOST_TEST(order++ == 2);
+            BOOST_TEST(mqtt::publish::is_dup(header) == false);
+            BOOST_TEST(mqtt::publish::get_qos(header) == mqtt::qos::at_most_once);
+            BOOST_TEST(mqtt::publish::is_retain(header) == false);
+            BOOST_CHECK(!packet_id);
+            BOOST_TEST(topic.to_string() == topic_base() + "/topic1");
+            BOOST_TEST(contents.to_string() == "topic1_contents");
+            pid_unsub = c->unsubscribe(topic_base() + "/topic1");
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(order++ == 5);
+}
+
+
+BOOST_AUTO_TEST_CASE( pub_qos0_batch ) {
+    fixture_clear_retain();
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+
+    int const count = 10;
+    int received = 0;
+
+    c->set_connack_handler(
+        [&c]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            c->subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_suback_handler(
+        [&c]
+        (std::uint16_t, std::vector<boost::optional<std::uint8_t>>) {
+            // The publish packets are written at once on flush().
+            c->begin_batch();
+            for (int i = 0; i != count; ++i) {
+                c->publish_at_most_once(topic_base() + "/topic1", "contents" + std::to_string(i));
+            }
+            BOOST_TEST(c->batching());
+            c->flush();
+            BOOST_TEST(!c->batching());
+            return true;
+        });
+    c->set_publish_handler(
+        [&c, &received]
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string contents) {
+            BOOST_TEST(contents == "contents" + std::to_string(received));
+            if (++received == count) c->disconnect();
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(received == count);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
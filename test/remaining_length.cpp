@@ -10,6 +10,41 @@
 
 BOOST_AUTO_TEST_SUITE(test_remaining_length)
 
+BOOST_AUTO_TEST_CASE( encode_decode ) {
+    for (std::size_t size : { 0, 127, 128, 16383, 16384, 2097151, 2097152, 268435455 }) {
+        char bytes[4];
+        char* end = mqtt::encode_remaining_length(size, bytes);
+        BOOST_TEST(static_cast<std::size_t>(end - bytes) == mqtt::remaining_length_size(size));
+        BOOST_TEST(std::string(bytes, end) == mqtt::remaining_bytes(size));
+        // Decoded by the loop if less than 4 bytes are available.
+        std::size_t length = 0;
+        BOOST_TEST(mqtt::decode_remaining_length(bytes, end - bytes, length) == mqtt::remaining_length_size(size));
+        BOOST_TEST(length == size);
+        char padded[5] = { 0, 0, 0, 0, 0 };
+        std::copy(bytes, end, padded);
+        BOOST_TEST(mqtt::decode_remaining_length(padded, sizeof(padded), length) == mqtt::remaining_length_size(size));
+        BOOST_TEST(length == size);
+        if (end - bytes > 1) {
+            BOOST_TEST(mqtt::decode_remaining_length(bytes, end - bytes - 1, length) == 0U);
+        }
+    }
+    BOOST_CHECK_THROW(mqtt::encode_remaining_length(268435456, nullptr), mqtt::remaining_length_error);
+    char overflow[5] = { '\xff', '\xff', '\xff', '\xff', '\x01' };
+    std::size_t length = 0;
+    BOOST_CHECK_THROW(mqtt::decode_remaining_length(overflow, sizeof(overflow), length), mqtt::remaining_length_error);
+    boost::system::error_code ec;
+    BOOST_TEST(mqtt::decode_remaining_length(overflow, sizeof(overflow), length, ec) == 0U);
+    BOOST_CHECK(ec == boost::system::errc::protocol_error);
+}
+
+BOOST_AUTO_TEST_CASE( compile_time ) {
+    constexpr auto e = mqtt::make_encoded_remaining_length(321);
+    static_assert(e.size == 2, "");
+    static_assert(e.bytes[0] == static_cast<char>(0xc1) && e.bytes[1] == 0x02, "");
+    constexpr char length[2] = { 0x01, 0x02 };
+    static_assert(mqtt::decode_length(length) == 0x0102, "");
+}
+
 BOOST_AUTO_TEST_CASE( pub_sub_over_127 ) {
     fixture_clear_retain();
     std::string test_contents;
@@ -192,6 +227,170 @@ BOOST_AUTO_TEST_CASE( pub_sub_over_16384 ) {
     BOOST_TEST(order++ == 5);
 }
 
+BOOST_AUTO_TEST_CASE( pub_sub_chunked ) {
+    fixture_clear_retain();
+    std::string test_contents;
+    for (std::size_t i = 0; i < 16384; ++i) {
+        test_contents.push_back(i);
+    }
+
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_read_buffer_size(1024);
+
+    std::uint16_t pid_sub;
+    std::uint16_t pid_unsub;
+
+    int order = 0;
+    c->set_connack_handler(
+        [&order, &c, &pid_sub]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(order++ == 0);
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            pid_sub = c->subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_close_handler(
+        [&order]
+        () {
+            BOOST_TEST(order++ == 4);
+        });
+    c->set_error_handler(
+        []
+        (boost::system::error_code const&) {
+            BOOST_CHECK(false);
+        });
+    c->set_puback_handler(
+        []
+        (std::uint16_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_pubrec_handler(
+        []
+        (std::uint16_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_pubcomp_handler(
+        []
+        (std::uint16_t) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->set_suback_handler(
+        [&order, &c, &pid_sub, &test_contents]
+        (std::uint16_t packet_id, std::vector<boost::optional<std::uint8_t>> results) {
+            BOOST_TEST(order++ == 1);
+            BOOST_TEST(packet_id == pid_sub);
+            BOOST_TEST(results.size() == 1U);
+            BOOST_TEST(*results[0] == mqtt::qos::at_most_once);
+            c->publish_at_most_once(topic_base() + "/topic1", test_contents);
+            return true;
+        });
+    c->set_unsuback_handler(
+        [&order, &c, &pid_unsub]
+        (std::uint16_t packet_id) {
+            BOOST_TEST(order++ == 3);
+            BOOST_TEST(packet_id == pid_unsub);
+            c->disconnect();
+            return true;
+        });
+    std::string received_contents;
+    c->set_publish_chunk_handlers(
+        [&order]
+        (std::uint8_t header,
+         boost::optional<std::uint16_t> packet_id,
+         mqtt::string_view topic,
+         std::size_t contents_size) {
+            BOOST_TEST(order == 2);
+            BOOST_TEST(mqtt::publish::is_dup(header) == false);
+            BOOST_TEST(mqtt::publish::get_qos(header) == mqtt::qos::at_most_once);
+            BOOST_TEST(mqtt::publish::is_retain(header) == false);
+            BOOST_CHECK(!packet_id);
+            BOOST_TEST(topic.to_string() == topic_base() + "/topic1");
+            BOOST_TEST(contents_size == 16384U);
+            return true;
+        },
+        [&order, &c, &pid_unsub, &test_contents, &received_contents]
+        (mqtt::string_view chunk, bool last) {
+            BOOST_TEST(chunk.size() <= 1024U);
+            received_contents.append(chunk.data(), chunk.size());
+            if (last) {
+                BOOST_TEST(order++ == 2);
+                BOOST_TEST(received_contents == test_contents);
+                pid_unsub = c->unsubscribe(topic_base() + "/topic1");
+            }
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(order++ == 5);
+}
+
+
+BOOST_AUTO_TEST_CASE( pub_sub_over_max_packet_size ) {
+    fixture_clear_retain();
+    std::string test_contents;
+    for (std::size_t i = 0; i < 16384; ++i) {
+        test_contents.push_back(i);
+    }
+
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_clean_session(true);
+    c->set_max_packet_size(1024);
+
+    std::uint16_t pid_sub;
+
+    int order = 0;
+    c->set_connack_handler(
+        [&order, &c, &pid_sub]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(order++ == 0);
+            BOOST_TEST(sp == false);
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            pid_sub = c->subscribe(topic_base() + "/topic1", mqtt::qos::at_most_once);
+            return true;
+        });
+    c->set_close_handler(
+        []
+        () {
+            BOOST_CHECK(false);
+        });
+    c->set_error_handler(
+        [&order]
+        (boost::system::error_code const& ec) {
+            BOOST_TEST(order++ == 2);
+            BOOST_CHECK(ec == boost::system::errc::message_size);
+        });
+    c->set_suback_handler(
+        [&order, &c, &pid_sub, &test_contents]
+        (std::uint16_t packet_id, std::vector<boost::optional<std::uint8_t>> results) {
+            BOOST_TEST(order++ == 1);
+            BOOST_TEST(packet_id == pid_sub);
+            BOOST_TEST(results.size() == 1U);
+            BOOST_TEST(*results[0] == mqtt::qos::at_most_once);
+            c->publish_at_most_once(topic_base() + "/topic1", test_contents);
+            return true;
+        });
+    c->set_publish_handler(
+        []
+        (std::uint8_t,
+         boost::optional<std::uint16_t>,
+         std::string,
+         std::string) {
+            BOOST_CHECK(false);
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(order++ == 3);
+}
+
+
 # if 0 // It would make network load too much.
 
 BOOST_AUTO_TEST_CASE( pub_sub_over_2097152 ) {
@@ -6,6 +6,7 @@
 #include "test_settings.hpp"
 
 #include <mqtt/client.hpp>
+#include <mqtt/log_session_store.hpp>
 
 BOOST_AUTO_TEST_SUITE(test_resend)
 
@@ -393,4 +394,176 @@ BOOST_AUTO_TEST_CASE( multi_publish_qos1 ) {
     BOOST_TEST(order++ == 8);
 }
 
+BOOST_AUTO_TEST_CASE( multi_publish_qos1_async_resend ) {
+    boost::asio::io_service ios;
+    auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+    c->set_client_id(cid1());
+    c->set_clean_session(true);
+    c->set_async_resend();
+    c->set_send_queue_watermarks(1024, 0, 1, 0);
+
+    std::uint16_t pid_pub1;
+    std::uint16_t pid_pub2;
+
+    int order = 0;
+    c->set_connack_handler(
+        [&order, &c, &pid_pub1, &pid_pub2]
+        (bool sp, std::uint8_t connack_return_code) {
+            BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+            switch (order++) {
+            case 0: // clean session
+                BOOST_TEST(sp == false);
+                c->disconnect();
+                break;
+            case 2:
+                BOOST_TEST(sp == false);
+                pid_pub1 = c->publish_at_least_once(topic_base() + "/topic1", "topic1_contents1");
+                pid_pub2 = c->publish_at_least_once(topic_base() + "/topic1", "topic1_contents2");
+                c->force_disconnect();
+                break;
+            case 4:
+                BOOST_TEST(sp == true);
+                break;
+            default:
+                BOOST_CHECK(false);
+                break;
+            }
+            return true;
+        });
+    c->set_close_handler(
+        [&order, &c]
+        () {
+            switch (order++) {
+            case 1:
+                c->set_clean_session(false);
+                c->connect();
+                break;
+            case 7:
+                break;
+            default:
+                BOOST_CHECK(false);
+                break;
+            }
+        });
+    c->set_error_handler(
+        [&order, &c]
+        (boost::system::error_code const&) {
+            BOOST_TEST(order++ == 3);
+            c->connect();
+        });
+    c->set_puback_handler(
+        [&order, &c, &pid_pub1, &pid_pub2]
+        (std::uint16_t packet_id) {
+            switch (order++) {
+            case 5:
+                BOOST_TEST(packet_id == pid_pub1);
+                break;
+            case 6:
+                BOOST_TEST(packet_id == pid_pub2);
+                c->async_disconnect();
+                break;
+            }
+            return true;
+        });
+    c->connect();
+    ios.run();
+    BOOST_TEST(order++ == 8);
+}
+
+BOOST_AUTO_TEST_CASE( publish_qos1_session_store ) {
+    std::string const path = "resend_session_store.log";
+    std::remove(path.c_str());
+    std::uint16_t pid_pub;
+
+    // The first client stores the publish and is disconnected before PUBACK.
+    {
+        boost::asio::io_service ios;
+        auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+        c->set_client_id(cid1());
+        c->set_clean_session(true);
+        c->set_session_store(std::make_shared<mqtt::log_session_store>(path, mqtt::fsync_policy::always));
+
+        int order = 0;
+        c->set_connack_handler(
+            [&order, &c, &pid_pub]
+            (bool sp, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                switch (order++) {
+                case 0: // clean session
+                    BOOST_TEST(sp == false);
+                    c->disconnect();
+                    break;
+                case 2:
+                    BOOST_TEST(sp == false);
+                    pid_pub = c->publish_at_least_once(topic_base() + "/topic1", "topic1_contents");
+                    c->force_disconnect();
+                    break;
+                default:
+                    BOOST_CHECK(false);
+                    break;
+                }
+                return true;
+            });
+        c->set_close_handler(
+            [&order, &c]
+            () {
+                BOOST_TEST(order++ == 1);
+                c->set_clean_session(false);
+                c->connect();
+            });
+        c->set_error_handler(
+            [&order]
+            (boost::system::error_code const&) {
+                BOOST_TEST(order++ == 3);
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(order++ == 4);
+    }
+
+    // The second client recovers the publish from the file, and resends it.
+    {
+        boost::asio::io_service ios;
+        auto c = mqtt::make_client(ios, broker_url, broker_notls_port);
+        c->set_client_id(cid1());
+        c->set_clean_session(false);
+        auto store = std::make_shared<mqtt::log_session_store>(path, mqtt::fsync_policy::always);
+        BOOST_TEST(store->size() == 1U);
+        c->set_session_store(store);
+
+        int order = 0;
+        c->set_connack_handler(
+            [&order]
+            (bool sp, std::uint8_t connack_return_code) {
+                BOOST_TEST(connack_return_code == mqtt::connect_return_code::accepted);
+                BOOST_TEST(order++ == 0);
+                BOOST_TEST(sp == true);
+                return true;
+            });
+        c->set_close_handler(
+            [&order]
+            () {
+                BOOST_TEST(order++ == 2);
+            });
+        c->set_error_handler(
+            []
+            (boost::system::error_code const&) {
+                BOOST_CHECK(false);
+            });
+        c->set_puback_handler(
+            [&order, &c, &pid_pub, &store]
+            (std::uint16_t packet_id) {
+                BOOST_TEST(order++ == 1);
+                BOOST_TEST(packet_id == pid_pub);
+                BOOST_TEST(store->size() == 0U);
+                c->disconnect();
+                return true;
+            });
+        c->connect();
+        ios.run();
+        BOOST_TEST(order++ == 3);
+    }
+    std::remove(path.c_str());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,92 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <deque>
+
+#include <mqtt/send_buffer_pool.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_send_buffer_pool)
+
+BOOST_AUTO_TEST_CASE( recycle ) {
+    mqtt::send_buffer_pool pool;
+    auto b1 = pool.acquire(100);
+    BOOST_TEST(b1->empty());
+    BOOST_TEST(b1->capacity() >= 128U);
+    BOOST_TEST(pool.miss_count() == 1U);
+    BOOST_TEST(pool.outstanding_bytes() == b1->capacity());
+    b1->assign(100, 'a');
+    auto p1 = b1.get();
+    b1.reset();
+    BOOST_TEST(pool.outstanding_bytes() == 0U);
+    BOOST_TEST(pool.pooled_count() == 1U);
+    auto b2 = pool.acquire(128);
+    BOOST_TEST(b2.get() == p1);
+    BOOST_TEST(b2->empty());
+    BOOST_TEST(pool.hit_count() == 1U);
+    BOOST_TEST(pool.miss_count() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( size_class ) {
+    mqtt::send_buffer_pool pool;
+    pool.acquire(64).reset();
+    // The pooled 64 bytes buffer is too small.
+    auto b1 = pool.acquire(65);
+    BOOST_TEST(pool.miss_count() == 2U);
+    // The buffer that has grown is pooled by its new capacity.
+    b1->assign(1000, 'a');
+    b1.reset();
+    auto b2 = pool.acquire(512);
+    BOOST_TEST(pool.hit_count() == 1U);
+    BOOST_TEST(b2->capacity() >= 1000U);
+}
+
+BOOST_AUTO_TEST_CASE( oversize ) {
+    mqtt::send_buffer_pool pool;
+    auto b1 = pool.acquire(mqtt::send_buffer_pool::max_class_size + 1);
+    b1.reset();
+    BOOST_TEST(pool.pooled_count() == 0U);
+    BOOST_TEST(pool.miss_count() == 1U);
+}
+
+BOOST_AUTO_TEST_CASE( max_pooled_bytes ) {
+    mqtt::send_buffer_pool pool(4096);
+    auto b1 = pool.acquire(4096);
+    auto b2 = pool.acquire(4096);
+    b1.reset();
+    b2.reset();
+    BOOST_TEST(pool.pooled_count() == 1U);
+    pool.set_max_pooled_bytes(0);
+    BOOST_TEST(pool.pooled_count() == 0U);
+    BOOST_TEST(pool.pooled_bytes() == 0U);
+}
+
+BOOST_AUTO_TEST_CASE( buffer_outlives_pool ) {
+    std::shared_ptr<std::string> b;
+    {
+        mqtt::send_buffer_pool pool;
+        b = pool.acquire(16);
+    }
+    b->assign("0123456789");
+    BOOST_TEST(*b == "0123456789");
+}
+
+BOOST_AUTO_TEST_CASE( allocator ) {
+    mqtt::send_buffer_pool pool;
+    std::deque<int, mqtt::send_buffer_pool::allocator<int>> q {
+        mqtt::send_buffer_pool::allocator<int>(pool)
+    };
+    for (int i = 0; i != 1000; ++i) q.push_back(i);
+    q.clear();
+    q.shrink_to_fit();
+    auto pooled = pool.pooled_bytes();
+    BOOST_TEST(pooled > 0U);
+    for (int i = 0; i != 1000; ++i) q.push_back(i);
+    BOOST_TEST(pool.pooled_bytes() < pooled);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
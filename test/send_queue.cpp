@@ -0,0 +1,79 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <limits>
+
+#include "loopback_endpoint.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_send_queue)
+
+BOOST_AUTO_TEST_CASE( control_lane_while_writing_one_puback ) {
+    loopback_endpoint c;
+    c.ep->set_write_coalescing(1, 64 * 1024);
+    auto filled = c.fill_socket();
+
+    // PUBACK 1 is written alone, and waits for the peer.
+    c.ep->async_puback(1);
+    // The control packets are queued in front of the publishes
+    // while PUBACK 1 is being written.
+    c.ep->async_publish_at_most_once("topic1", "a");
+    c.ep->async_publish_at_most_once("topic1", "b");
+    c.ep->async_publish_at_most_once("topic1", "c");
+    c.ep->async_puback(2);
+    c.ep->async_pingreq();
+
+    std::string const publish_a("\x30\x09\x00\x06topic1a", 11);
+    std::string const publish_b("\x30\x09\x00\x06topic1b", 11);
+    std::string const publish_c("\x30\x09\x00\x06topic1c", 11);
+    std::string const expected =
+        std::string("\x40\x02\x00\x01", 4) +
+        std::string("\x40\x02\x00\x02", 4) +
+        std::string("\xc0\x00", 2) +
+        publish_a + publish_b + publish_c;
+    auto bytes = c.read_peer(filled + expected.size());
+    BOOST_TEST(bytes.substr(filled) == expected);
+}
+
+BOOST_AUTO_TEST_CASE( drop_oldest_qos0_while_writing_one_puback ) {
+    loopback_endpoint c;
+    c.ep->set_write_coalescing(1, 64 * 1024);
+    c.ep->set_send_queue_watermarks(
+        std::numeric_limits<std::size_t>::max(),
+        std::numeric_limits<std::size_t>::max(),
+        4,
+        0);
+    c.ep->set_send_queue_policy(mqtt::send_queue_policy::drop_oldest_qos0);
+    auto filled = c.fill_socket();
+
+    // PUBACK 1 is written alone, and waits for the peer.
+    c.ep->async_puback(1);
+    boost::system::error_code dropped;
+    c.ep->async_publish_at_most_once(
+        "topic1", "a", false,
+        [&](boost::system::error_code const& ec) {
+            dropped = ec;
+        }
+    );
+    c.ep->async_publish_at_most_once("topic1", "b");
+    c.ep->async_publish_at_most_once("topic1", "c");
+    // The queue is high, so the publish a is dropped while PUBACK 1 is being written.
+    c.ep->async_publish_at_most_once("topic1", "d");
+    BOOST_TEST(dropped == boost::system::errc::operation_canceled);
+
+    std::string const publish_b("\x30\x09\x00\x06topic1b", 11);
+    std::string const publish_c("\x30\x09\x00\x06topic1c", 11);
+    std::string const publish_d("\x30\x09\x00\x06topic1d", 11);
+    std::string const expected =
+        std::string("\x40\x02\x00\x01", 4) +
+        publish_b + publish_c + publish_d;
+    auto bytes = c.read_peer(filled + expected.size());
+    BOOST_TEST(bytes.substr(filled) == expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,42 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <mqtt/topic_handle.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_topic_handle)
+
+BOOST_AUTO_TEST_CASE( encoded ) {
+    mqtt::topic_handle h("a/b");
+    BOOST_TEST(h.name() == "a/b");
+    BOOST_TEST(h.encoded() == mqtt::string_view("\x00\x03" "a/b", 5));
+
+    // The copies share the encoded bytes.
+    mqtt::topic_handle h2 = h;
+    BOOST_TEST(h2.encoded().data() == h.encoded().data());
+}
+
+BOOST_AUTO_TEST_CASE( view ) {
+    std::string name("a/b");
+    mqtt::topic_view v1(name);
+    BOOST_TEST(v1.name() == "a/b");
+    BOOST_TEST(v1.encoded().empty());
+
+    mqtt::topic_handle h(name);
+    mqtt::topic_view v2(h);
+    BOOST_TEST(v2.name() == "a/b");
+    BOOST_TEST(v2.encoded().data() == h.encoded().data());
+}
+
+BOOST_AUTO_TEST_CASE( invalid ) {
+    BOOST_CHECK_THROW(mqtt::topic_handle(std::string(0x10000, 'a')), mqtt::utf8string_length_error);
+    BOOST_CHECK_THROW(mqtt::topic_handle("\xff"), mqtt::utf8string_contents_error);
+    mqtt::topic_handle h("\xff", false);
+    BOOST_TEST(h.encoded().size() == 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
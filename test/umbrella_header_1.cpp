@@ -0,0 +1,21 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+// umbrella_header_1.cpp and umbrella_header_2.cpp include the same headers
+// to check that they can be linked together without multiple definitions.
+
+#include <boost/test/unit_test.hpp>
+
+#include <mqtt_client_cpp.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_umbrella_header_1)
+
+BOOST_AUTO_TEST_CASE( link ) {
+    mqtt::packet_parser parser;
+    BOOST_TEST(parser.required() == 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,72 @@
+// Copyright Takatoshi Kondo 2016
+//
+// Distributed under the Boost Software License, Version 1.0.
+// (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+
+#include <boost/test/unit_test.hpp>
+
+#include <mqtt/utf8encoded_strings.hpp>
+
+BOOST_AUTO_TEST_SUITE(test_utf8encoded_strings)
+
+namespace {
+
+mqtt::utf8string::validation validate(std::string const& str) {
+    return mqtt::utf8string::validate_contents(str);
+}
+
+// Put str at every position of a long ASCII string to check both the SIMD and the scalar paths.
+void check_all_positions(std::string const& str, mqtt::utf8string::validation expected) {
+    for (std::size_t i = 0; i < 70; ++i) {
+        std::string s = std::string(i, 'a') + str + std::string(70 - i, 'b');
+        BOOST_CHECK(validate(s) == expected);
+    }
+}
+
+} // anonymous namespace
+
+BOOST_AUTO_TEST_CASE( well_formed ) {
+    using mqtt::utf8string::validation;
+    BOOST_CHECK(validate("") == validation::well_formed);
+    BOOST_CHECK(validate("sensor/room1/temperature") == validation::well_formed);
+    check_all_positions("\xc2\xa0", validation::well_formed);          // U+00A0
+    check_all_positions("\xe3\x81\x82", validation::well_formed);      // U+3042
+    check_all_positions("\xed\x9f\xbf", validation::well_formed);      // U+D7FF
+    check_all_positions("\xee\x80\x80", validation::well_formed);      // U+E000
+    check_all_positions("\xf0\x9f\x98\x80", validation::well_formed);  // U+1F600
+    check_all_positions("\xf4\x8f\xbf\xbd", validation::well_formed);  // U+10FFFD
+}
+
+BOOST_AUTO_TEST_CASE( well_formed_with_non_character ) {
+    using mqtt::utf8string::validation;
+    check_all_positions("\x01", validation::well_formed_with_non_character);             // U+0001
+    check_all_positions("\x1f", validation::well_formed_with_non_character);             // U+001F
+    check_all_positions("\x7f", validation::well_formed_with_non_character);             // U+007F
+    check_all_positions("\xc2\x9f", validation::well_formed_with_non_character);         // U+009F
+    check_all_positions("\xef\xb7\x90", validation::well_formed_with_non_character);     // U+FDD0
+    check_all_positions("\xef\xbf\xbf", validation::well_formed_with_non_character);     // U+FFFF
+    check_all_positions("\xf4\x8f\xbf\xbe", validation::well_formed_with_non_character); // U+10FFFE
+    BOOST_TEST(mqtt::utf8string::is_valid_contents(std::string("\x01")));
+}
+
+BOOST_AUTO_TEST_CASE( ill_formed ) {
+    using mqtt::utf8string::validation;
+    check_all_positions(std::string(1, '\0'), validation::ill_formed);  // U+0000
+    check_all_positions("\x80", validation::ill_formed);                // continuation byte
+    check_all_positions("\xc0\x80", validation::ill_formed);            // overlong U+0000
+    check_all_positions("\xc1\xbf", validation::ill_formed);            // overlong U+007F
+    check_all_positions("\xe0\x9f\xbf", validation::ill_formed);        // overlong U+07FF
+    check_all_positions("\xed\xa0\x80", validation::ill_formed);        // U+D800
+    check_all_positions("\xed\xbf\xbf", validation::ill_formed);        // U+DFFF
+    check_all_positions("\xf0\x8f\xbf\xbf", validation::ill_formed);    // overlong U+FFFF
+    check_all_positions("\xf4\x90\x80\x80", validation::ill_formed);    // U+110000
+    check_all_positions("\xf5\x80\x80\x80", validation::ill_formed);
+    check_all_positions("\xff", validation::ill_formed);
+    check_all_positions("\xe3\x81", validation::ill_formed);            // truncated
+    BOOST_CHECK(validate("\xe3\x81") == validation::ill_formed);        // truncated at the end
+    BOOST_CHECK(validate("\xf0\x9f\x98") == validation::ill_formed);
+    BOOST_TEST(!mqtt::utf8string::is_valid_contents(std::string("a\0b", 3)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()